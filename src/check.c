@@ -0,0 +1,355 @@
+// fork, wait y sysconf no forman parte de C99
+#define _POSIX_C_SOURCE 200809L
+
+#include "stroff.h"
+#include <stdarg.h>
+
+// --check: valida documentos sin maquetarlos. Solo se hace el recorrido previo
+// (lee el documento y todos sus includes, expande macros y condicionales) y cada
+// comando pasa por check_command, que avisa de lo que la maquetación ignoraría o
+// recortaría en silencio. Cada error lleva archivo y línea; los documentos se
+// comprueban en paralelo, uno por proceso
+
+// Bloques con comando de apertura y de cierre
+typedef enum {
+    BLOCK_DOCUMENT,
+    BLOCK_CODE,
+    BLOCK_LIST,
+    BLOCK_TABLE,
+    BLOCK_KEEP,
+    BLOCK_COUNT
+} check_block_kind_t;
+
+static const char *const block_commands[BLOCK_COUNT][2] = {
+    {"DOCUMENT", "EDOC"},
+    {"CODE", "ECODE"},
+    {"LIST", "ELIST"},
+    {"TABLE", "ETABLE"},
+    {"KEEP", "EKEEP"},
+};
+
+typedef struct {
+    int open;
+    int line;
+    char path[MAX_PATH_LENGTH];     // Dónde se abrió, para avisar si no se cierra
+} check_block_t;
+
+struct check_state {
+    const char *document;   // Documento principal: situación de los errores sin línea
+    int errors;
+    int heading_count;
+    int table_name_count;
+    int list_items;         // .ITEM de la lista abierta
+    int table_cols;         // Columnas del .TABLE abierto
+    check_block_t blocks[BLOCK_COUNT];
+};
+
+// Comandos de process_command, en orden de strcmp para bsearch. Los de
+// condicionales y macros no llegan aquí: los consumen antes
+static const char *const known_commands[] = {
+    "AUTH", "BREAK", "BULLET", "CHAP", "CODE", "DATE", "DOCUMENT", "ECODE", "EDOC",
+    "EKEEP", "ELIST", "ETABLE", "FOOTALIGN", "FOOTER", "HEADALIGN", "HEADER",
+    "HYPHENATE", "INCLUDE", "INDENT", "INDEX", "ITEM", "JUSTIFY", "KEEP", "LABEL",
+    "LINESPACE", "LIST", "LMARGIN", "MAKEINDEX", "MAKETOC", "MAKETOT", "P",
+    "PAGEBREAK", "PAGEHEIGHT", "PAGEWIDTH", "RMARGIN", "SUBCHAP", "SUBSUBCHAP",
+    "TABLE", "TABLEFILE", "TABSIZE", "TH", "TITLE", "TLINE", "TR",
+};
+
+#define KNOWN_COMMAND_COUNT ((int)(sizeof(known_commands) / sizeof(known_commands[0])))
+
+static int compare_command(const void *key, const void *entry) {
+    return strcmp(*(const char *const *)key, *(const char *const *)entry);
+}
+
+static void print_location(const char *path, int line) {
+    if (line > 0) {
+        fprintf(stderr, "%s:%d: ", path, line);
+    } else {
+        fprintf(stderr, "%s: ", path);
+    }
+}
+
+// Prefijo de un error. Con --check lo sitúa en el archivo y la línea actuales
+// (o en el documento, fuera de cualquier archivo) y lo cuenta
+void begin_error(const stroff_context_t *ctx) {
+    if (ctx->check) {
+        ctx->check->errors++;
+        if (ctx->source_path) {
+            print_location(ctx->source_path, ctx->source_line);
+        } else {
+            print_location(ctx->check->document, 0);
+        }
+    }
+    fputs("Error: ", stderr);
+}
+
+void report_error(const stroff_context_t *ctx, const char *format, ...) {
+    begin_error(ctx);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+static void open_block(stroff_context_t *ctx, check_block_kind_t kind) {
+    check_block_t *block = &ctx->check->blocks[kind];
+    if (block->open) {
+        report_error(ctx, "'.%s' con el '.%s' de %s:%d sin cerrar", block_commands[kind][0],
+                     block_commands[kind][0], block->path, block->line);
+    }
+    const char *path = ctx->source_path ? ctx->source_path : ctx->check->document;
+    strncpy(block->path, path, MAX_PATH_LENGTH - 1);
+    block->path[MAX_PATH_LENGTH - 1] = '\0';
+    block->line = ctx->source_path ? ctx->source_line : 0;
+    block->open = 1;
+}
+
+static void close_block(stroff_context_t *ctx, check_block_kind_t kind) {
+    check_block_t *block = &ctx->check->blocks[kind];
+    if (!block->open) {
+        report_error(ctx, "'.%s' sin '.%s'", block_commands[kind][1], block_commands[kind][0]);
+    }
+    block->open = 0;
+}
+
+// Títulos, cabeceras y nombres se copian en campos de MAX_TITLE_LENGTH bytes
+static void check_title(stroff_context_t *ctx, const char *command, const char *text) {
+    int length = text ? (int)strlen(text) : 0;
+    if (length > MAX_TITLE_LENGTH - 1) {
+        report_error(ctx, "Texto de '.%s' de %d bytes: se recorta a %d", command, length, MAX_TITLE_LENGTH - 1);
+    }
+}
+
+// .TABLE/.TABLEFILE: columnas, nombre para la TOT y, en .TABLEFILE, el archivo
+static void check_table(stroff_context_t *ctx, const command_line_t *cmd) {
+    check_state_t *state = ctx->check;
+    int cols = command_key_int(cmd, KEY_COLS);
+    if (cols > MAX_TABLE_COLS) {
+        report_error(ctx, "COLS=%d: una tabla tiene como máximo %d columnas", cols, MAX_TABLE_COLS);
+        cols = MAX_TABLE_COLS;
+    }
+
+    const command_token_t *name = command_key(cmd, KEY_NAME);
+    if (name) {
+        check_title(ctx, cmd->name, name->text);
+        if (++state->table_name_count == MAX_TABLES + 1) {
+            report_error(ctx, "Más de %d tablas con NAME=: las siguientes no aparecen en la TOT", MAX_TABLES);
+        }
+    }
+
+    if (strcmp(cmd->name, "TABLE") == 0) {
+        state->table_cols = cols;
+        return;
+    }
+
+    const char *filename = command_string(cmd);
+    if (filename) {
+        char resolved[MAX_PATH_LENGTH];
+        resolve_include_path(ctx, filename, resolved);
+        FILE *file = fopen(resolved, "r");
+        if (file) {
+            fclose(file);
+        } else {
+            report_error(ctx, "No se puede abrir el archivo '%s'", resolved);
+        }
+    }
+}
+
+// Celdas de .TH/.TR: las que pasan de las columnas de la tabla se descartan y
+// las cabeceras se recortan a MAX_TITLE_LENGTH
+static void check_table_cells(stroff_context_t *ctx, const char *line, int header) {
+    const char *current = strchr(line, '"');
+    if (!current) return;
+    current++;
+
+    int cells = 0;
+    while (*current) {
+        const char *end = strchr(current, '"');
+        if (!end) break;
+        if (header && end - current > MAX_TITLE_LENGTH - 1) {
+            report_error(ctx, "Cabecera de %d bytes: se recorta a %d", (int)(end - current), MAX_TITLE_LENGTH - 1);
+        }
+        cells++;
+
+        current = end + 1;
+        while (*current == ' ' || *current == '|') current++;
+        if (*current == '"') current++;
+    }
+
+    int cols = ctx->check->table_cols;
+    if (cells > cols) {
+        report_error(ctx, "La fila tiene %d celdas y la tabla %d columnas: se descartan %d",
+                     cells, cols, cells - cols);
+    }
+}
+
+// Comando ya separado en tokens, llamado desde el recorrido previo
+void check_command(stroff_context_t *ctx, const char *line, const command_line_t *cmd) {
+    check_state_t *state = ctx->check;
+    const char *command = cmd->name;
+
+    if (!bsearch(&command, known_commands, KNOWN_COMMAND_COUNT, sizeof(known_commands[0]), compare_command)) {
+        report_error(ctx, "Comando desconocido '.%s'", command);
+        return;
+    }
+
+    for (int kind = 0; kind < BLOCK_COUNT; kind++) {
+        if (strcmp(command, block_commands[kind][0]) == 0) {
+            open_block(ctx, (check_block_kind_t)kind);
+        } else if (strcmp(command, block_commands[kind][1]) == 0) {
+            close_block(ctx, (check_block_kind_t)kind);
+        }
+    }
+
+    if (strcmp(command, "CHAP") == 0 || strcmp(command, "SUBCHAP") == 0 || strcmp(command, "SUBSUBCHAP") == 0) {
+        check_title(ctx, command, command_string(cmd));
+        if (++state->heading_count == MAX_CHAPTERS + 1) {
+            report_error(ctx, "Más de %d encabezados: los siguientes no aparecen en el TOC", MAX_CHAPTERS);
+        }
+    }
+    else if (strcmp(command, "TITLE") == 0 || strcmp(command, "AUTH") == 0 || strcmp(command, "DATE") == 0 ||
+             strcmp(command, "HEADER") == 0 || strcmp(command, "FOOTER") == 0) {
+        check_title(ctx, command, command_string(cmd));
+    }
+    else if (strcmp(command, "LIST") == 0 || strcmp(command, "ELIST") == 0) {
+        state->list_items = 0;
+    }
+    else if (strcmp(command, "ITEM") == 0) {
+        if (++state->list_items == MAX_LIST_ITEMS + 1) {
+            report_error(ctx, "Más de %d elementos en la lista: los siguientes se descartan", MAX_LIST_ITEMS);
+        }
+    }
+    else if (strcmp(command, "TABLE") == 0 || strcmp(command, "TABLEFILE") == 0) {
+        check_table(ctx, cmd);
+    }
+    else if (strcmp(command, "ETABLE") == 0) {
+        state->table_cols = 0;
+    }
+    else if (strcmp(command, "TH") == 0 || strcmp(command, "TR") == 0) {
+        check_table_cells(ctx, line, command[1] == 'H');
+    }
+}
+
+// Lo que sigue abierto al terminar el documento
+static void finish_check(stroff_context_t *ctx) {
+    check_state_t *state = ctx->check;
+    for (int kind = 0; kind < BLOCK_COUNT; kind++) {
+        const check_block_t *block = &state->blocks[kind];
+        if (!block->open) continue;
+        state->errors++;
+        print_location(block->path, block->line);
+        fprintf(stderr, "Error: '.%s' sin '.%s' al final del documento\n",
+                block_commands[kind][0], block_commands[kind][1]);
+    }
+
+    if (ctx->recording_macro >= 0) {
+        report_error(ctx, ".MACRO %s sin .EMACRO al final del documento", ctx->macros[ctx->recording_macro].name);
+    }
+    report_unresolved_labels(ctx);
+}
+
+// Recorrido previo de un documento en un contexto propio. Devuelve los errores
+static int check_document(const char *path, const char **defines, int define_count,
+                          const char **include_dirs, int include_dir_count) {
+    stroff_context_t ctx;
+    init_context(&ctx);
+    for (int i = 0; i < define_count; i++) {
+        add_command_line_define(&ctx, defines[i]);
+    }
+    clear_macros(&ctx);
+    for (int i = 0; i < include_dir_count; i++) {
+        add_include_dir(&ctx, include_dirs[i]);
+    }
+
+    check_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.document = path;
+    ctx.check = &state;
+
+    // Un .stc también se valida, aunque sus errores no llevan línea
+    if (open_compiled_document(&ctx, path) < 0) {
+        state.errors++;
+    } else {
+        ctx.outline_only = 1;
+        process_file(&ctx, path);
+        finish_check(&ctx);
+    }
+
+    int errors = state.errors;
+    free_context(&ctx);
+    return errors;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// stderr de cada proceso: el informe sale de una vez al terminar y no se mezcla
+// con el de los demás documentos (salvo que pase de este tamaño)
+#define CHECK_REPORT_BUFFER (64 * 1024)
+
+// Un proceso por documento, tantos a la vez como procesadores. Devuelve cuántos
+// documentos tienen errores
+static int check_in_parallel(const char **paths, int count, const char **defines, int define_count,
+                             const char **include_dirs, int include_dir_count) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = cpus > 0 && cpus < count ? (int)cpus : count;
+    int next = 0;
+    int running = 0;
+    int failed = 0;
+
+    fflush(stdout);
+    fflush(stderr);
+    while (next < count || running > 0) {
+        if (next < count && running < workers) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                setvbuf(stderr, NULL, _IOFBF, CHECK_REPORT_BUFFER);
+                int errors = check_document(paths[next], defines, define_count, include_dirs, include_dir_count);
+                exit(errors > 0 ? 1 : 0);
+            }
+            if (pid < 0) {
+                // Sin procesos nuevos se comprueba aquí mismo
+                failed += check_document(paths[next], defines, define_count, include_dirs, include_dir_count) > 0;
+            } else {
+                running++;
+            }
+            next++;
+            continue;
+        }
+
+        int status;
+        if (wait(&status) < 0) break;
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+    }
+    return failed;
+}
+
+#else
+
+static int check_in_parallel(const char **paths, int count, const char **defines, int define_count,
+                             const char **include_dirs, int include_dir_count) {
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        failed += check_document(paths[i], defines, define_count, include_dirs, include_dir_count) > 0;
+    }
+    return failed;
+}
+
+#endif
+
+// Valida los documentos; devuelve 0 si ninguno tiene errores
+int check_documents(const char **paths, int count, const char **defines, int define_count,
+                    const char **include_dirs, int include_dir_count) {
+    if (count == 1) {
+        return check_document(paths[0], defines, define_count, include_dirs, include_dir_count) > 0;
+    }
+
+    int failed = check_in_parallel(paths, count, defines, define_count, include_dirs, include_dir_count);
+    fprintf(stderr, "%d documentos comprobados, %d con errores\n", count, failed);
+    return failed > 0;
+}
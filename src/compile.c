@@ -0,0 +1,507 @@
+// mmap, fileno y struct stat no forman parte de C99
+#define _POSIX_C_SOURCE 200809L
+
+#include "stroff.h"
+#include <stdint.h>
+#include <sys/stat.h>
+
+// --compile: documento precompilado (.stc). Los .INCLUDE se resuelven al compilar
+// y cada línea queda ya clasificada (vacía, comentario, comando o texto) con su
+// sangría medida, así que renderizar no abre, lee, corta ni recorta ningún
+// archivo fuente. Lo que depende de los parámetros de cada ejecución (.IF, -D,
+// {VARIABLES}, macros, bloques de código) se sigue resolviendo al renderizar: las
+// líneas con llaves o espacios finales, y todas las de un estado especial, pasan
+// por process_line() como si vinieran del archivo.
+//
+// Formato (orden de bytes nativo, comprobado con byte_order):
+//   cabecera | dependencias | registros | pool de cadenas terminadas en '\0'
+// La carga es un solo mmap de solo lectura: la cabecera, los registros y las
+// cadenas se usan en su sitio, sin copiarlos
+
+#define STC_MAGIC "STROFFC"         // 8 bytes con el '\0'
+#define STC_VERSION 1
+#define STC_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t dependency_count;
+    uint32_t dependencies_offset;
+    uint32_t record_count;
+    uint32_t records_offset;
+    uint32_t pool_size;
+    uint32_t pool_offset;
+} stc_header_t;
+
+// Archivo leído al compilar: si cambia, el .stc se ha quedado viejo
+typedef struct {
+    uint32_t path;          // Offset en el pool
+    uint32_t reserved;
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash;          // FNV-1a de 64 bits del contenido
+} stc_dependency_t;
+
+typedef enum {
+    STC_LINE,
+    STC_ENTER,              // Empieza un archivo incluido (text = ruta resuelta)
+    STC_LEAVE
+} stc_record_kind_t;
+
+typedef enum {
+    STC_BLANK,
+    STC_COMMENT,
+    STC_COMMAND,
+    STC_TEXT
+} stc_line_kind_t;
+
+#define STC_EXPAND 0x01     // Llaves o espacios finales: la línea pasa por process_line()
+
+typedef struct {
+    uint8_t kind;           // stc_record_kind_t
+    uint8_t line_kind;      // stc_line_kind_t
+    uint8_t flags;
+    uint8_t lead;           // Espacios iniciales: text + lead es la línea recortada
+    uint32_t text;          // Offset de la línea tal cual en el pool
+} stc_record_t;
+
+struct compiled_document {
+    const unsigned char *base;
+    size_t size;
+    int mapped;             // 0: leído con fread (sistemas sin mmap)
+    const stc_header_t *header;
+    const stc_dependency_t *dependencies;
+    const stc_record_t *records;
+    const char *pool;
+};
+
+static uint64_t content_hash(const char *data, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static char *read_whole_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    size_t capacity = 4096;
+    size_t used = 0;
+    char *data = malloc(capacity);
+    size_t read;
+    while (data && (read = fread(data + used, 1, capacity - used, file)) > 0) {
+        used += read;
+        if (used == capacity) {
+            capacity *= 2;
+            char *grown = realloc(data, capacity);
+            if (!grown) free(data);
+            data = grown;
+        }
+    }
+    fclose(file);
+    *length = used;
+    return data;
+}
+
+// Compilación
+
+typedef struct {
+    stroff_context_t *ctx;
+    stc_record_t *records;
+    int record_count;
+    int record_capacity;
+    stc_dependency_t *dependencies;
+    int dependency_count;
+    int dependency_capacity;
+    char *pool;
+    size_t pool_size;
+    size_t pool_capacity;
+    int in_code;            // Seguimiento estático de .CODE y .MACRO: dentro no se
+    int in_macro;           // expande ningún .INCLUDE
+    int include_macro;      // Una macro sustituye a .INCLUDE
+    int failed;
+} compiler_t;
+
+static void *compiler_realloc(compiler_t *compiler, void *data, size_t size) {
+    void *grown = realloc(data, size);
+    if (!grown) {
+        fprintf(stderr, "Error: Memoria insuficiente para compilar el documento\n");
+        compiler->failed = 1;
+    }
+    return grown;
+}
+
+static uint32_t pool_add(compiler_t *compiler, const char *text, size_t length) {
+    if (compiler->pool_size + length + 1 > compiler->pool_capacity) {
+        size_t capacity = compiler->pool_capacity ? compiler->pool_capacity * 2 : 65536;
+        while (capacity < compiler->pool_size + length + 1) capacity *= 2;
+        char *grown = compiler_realloc(compiler, compiler->pool, capacity);
+        if (!grown) return 0;
+        compiler->pool = grown;
+        compiler->pool_capacity = capacity;
+    }
+    uint32_t offset = (uint32_t)compiler->pool_size;
+    memcpy(compiler->pool + offset, text, length);
+    compiler->pool[offset + length] = '\0';
+    compiler->pool_size += length + 1;
+    return offset;
+}
+
+static void add_record(compiler_t *compiler, const stc_record_t *record) {
+    if (compiler->record_count == compiler->record_capacity) {
+        int capacity = compiler->record_capacity ? compiler->record_capacity * 2 : 1024;
+        stc_record_t *grown = compiler_realloc(compiler, compiler->records, sizeof(stc_record_t) * (size_t)capacity);
+        if (!grown) return;
+        compiler->records = grown;
+        compiler->record_capacity = capacity;
+    }
+    compiler->records[compiler->record_count++] = *record;
+}
+
+static void add_compiled_dependency(compiler_t *compiler, const char *path, const char *data, size_t length) {
+    add_dependency(compiler->ctx, path);
+    for (int i = 0; i < compiler->dependency_count; i++) {
+        if (strcmp(compiler->pool + compiler->dependencies[i].path, path) == 0) return;
+    }
+
+    if (compiler->dependency_count == compiler->dependency_capacity) {
+        int capacity = compiler->dependency_capacity ? compiler->dependency_capacity * 2 : 16;
+        stc_dependency_t *grown = compiler_realloc(compiler, compiler->dependencies,
+                                                   sizeof(stc_dependency_t) * (size_t)capacity);
+        if (!grown) return;
+        compiler->dependencies = grown;
+        compiler->dependency_capacity = capacity;
+    }
+
+    struct stat info;
+    stc_dependency_t *dependency = &compiler->dependencies[compiler->dependency_count++];
+    memset(dependency, 0, sizeof(stc_dependency_t));
+    dependency->path = pool_add(compiler, path, strlen(path));
+    dependency->size = length;
+    dependency->mtime = stat(path, &info) == 0 ? (int64_t)info.st_mtime : 0;
+    dependency->hash = content_hash(data, length);
+}
+
+// Nombre del comando de una línea recortada que empieza por '.'
+static int command_is(const char *trimmed, const char *name) {
+    size_t len = strlen(name);
+    return strncmp(trimmed + 1, name, len) == 0 &&
+           (trimmed[len + 1] == '\0' || isspace((unsigned char)trimmed[len + 1]));
+}
+
+static int compile_file(compiler_t *compiler, const char *filename);
+
+static void compile_line(compiler_t *compiler, const char *text, size_t length) {
+    stc_record_t record = {STC_LINE, STC_BLANK, 0, 0, 0};
+    char line[MAX_LINE_LENGTH];
+    memcpy(line, text, length);
+    line[length] = '\0';
+
+    size_t lead = 0;
+    while (lead < length && isspace((unsigned char)line[lead])) lead++;
+    if (lead < length) {
+        const char *trimmed = line + lead;
+        record.line_kind = trimmed[0] == '#' ? STC_COMMENT : trimmed[0] == '.' ? STC_COMMAND : STC_TEXT;
+        if (lead > 255 || isspace((unsigned char)line[length - 1]) || memchr(line, '{', length)) {
+            record.flags |= STC_EXPAND;
+        }
+        record.lead = (uint8_t)(lead > 255 ? 0 : lead);
+
+        if (compiler->in_code) {
+            if (command_is(trimmed, "ECODE")) compiler->in_code = 0;
+        } else if (compiler->in_macro) {
+            if (command_is(trimmed, "EMACRO")) compiler->in_macro = 0;
+        } else if (record.line_kind == STC_COMMAND) {
+            if (command_is(trimmed, "CODE")) {
+                compiler->in_code = 1;
+            } else if (command_is(trimmed, "MACRO")) {
+                compiler->in_macro = 1;
+                const char *name = trimmed + 6 + strspn(trimmed + 6, " \t");
+                if (strncmp(name, "INCLUDE", 7) == 0 && (name[7] == '\0' || isspace((unsigned char)name[7]))) {
+                    compiler->include_macro = 1;
+                }
+            } else if (command_is(trimmed, "INCLUDE") && !(record.flags & STC_EXPAND) && !compiler->include_macro) {
+                command_line_t cmd;
+                lex_command(trimmed, &cmd);
+                const char *filename = command_string(&cmd);
+                // Un archivo que no existe al compilar se deja para el renderizado
+                if (filename && compile_file(compiler, filename)) return;
+            }
+        }
+    }
+
+    record.text = pool_add(compiler, line, length);
+    add_record(compiler, &record);
+}
+
+// Devuelve 0 si el archivo no se puede leer; los ciclos y el exceso de
+// profundidad hacen fallar la compilación entera
+static int compile_file(compiler_t *compiler, const char *filename) {
+    stroff_context_t *ctx = compiler->ctx;
+    char resolved_path[MAX_PATH_LENGTH];
+    resolve_include_path(ctx, filename, resolved_path);
+
+    size_t length;
+    char *data = read_whole_file(resolved_path, &length);
+    if (!data) return 0;
+    if (!enter_include(ctx, resolved_path)) {
+        free(data);
+        compiler->failed = 1;
+        return 1;
+    }
+    add_compiled_dependency(compiler, resolved_path, data, length);
+
+    stc_record_t enter = {STC_ENTER, 0, 0, 0, pool_add(compiler, resolved_path, strlen(resolved_path))};
+    add_record(compiler, &enter);
+
+    // Mismo corte de líneas que fgets() con un buffer de MAX_LINE_LENGTH
+    size_t pos = 0;
+    while (pos < length && !compiler->failed) {
+        size_t available = length - pos;
+        size_t max = available < MAX_LINE_LENGTH - 1 ? available : MAX_LINE_LENGTH - 1;
+        const char *newline = memchr(data + pos, '\n', max);
+        size_t n = newline ? (size_t)(newline - (data + pos)) : max;
+        compile_line(compiler, data + pos, n);
+        pos += newline ? n + 1 : n;
+    }
+
+    stc_record_t leave = {STC_LEAVE, 0, 0, 0, 0};
+    add_record(compiler, &leave);
+    leave_include(ctx);
+    free(data);
+    return 1;
+}
+
+int compile_document(stroff_context_t *ctx, const char *input_path, const char *output_path) {
+    compiler_t compiler;
+    memset(&compiler, 0, sizeof(compiler));
+    compiler.ctx = ctx;
+    pool_add(&compiler, "", 0);
+    // Como en el recorrido previo: los ciclos de .INCLUDE se avisan
+    ctx->outline_only = 1;
+
+    if (!compile_file(&compiler, input_path)) {
+        fprintf(stderr, "Error: No se puede abrir el archivo '%s'\n", input_path);
+        compiler.failed = 1;
+    }
+
+    ctx->outline_only = 0;
+
+    int ok = !compiler.failed;
+    if (ok) {
+        stc_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, STC_MAGIC, sizeof(STC_MAGIC));
+        header.version = STC_VERSION;
+        header.byte_order = STC_BYTE_ORDER;
+        header.dependency_count = (uint32_t)compiler.dependency_count;
+        header.dependencies_offset = sizeof(stc_header_t);
+        header.record_count = (uint32_t)compiler.record_count;
+        header.records_offset = header.dependencies_offset +
+                                (uint32_t)(sizeof(stc_dependency_t) * (size_t)compiler.dependency_count);
+        header.pool_size = (uint32_t)compiler.pool_size;
+        header.pool_offset = header.records_offset +
+                             (uint32_t)(sizeof(stc_record_t) * (size_t)compiler.record_count);
+
+        FILE *output = fopen(output_path, "wb");
+        if (!output) {
+            fprintf(stderr, "Error: No se puede abrir el archivo de salida '%s'\n", output_path);
+            ok = 0;
+        } else {
+            fwrite(&header, sizeof(header), 1, output);
+            fwrite(compiler.dependencies, sizeof(stc_dependency_t), (size_t)compiler.dependency_count, output);
+            fwrite(compiler.records, sizeof(stc_record_t), (size_t)compiler.record_count, output);
+            fwrite(compiler.pool, 1, compiler.pool_size, output);
+            if (ferror(output) | fclose(output)) {
+                fprintf(stderr, "Error: No se puede escribir el archivo de salida '%s'\n", output_path);
+                ok = 0;
+            }
+        }
+    }
+
+    free(compiler.records);
+    free(compiler.dependencies);
+    free(compiler.pool);
+    return ok;
+}
+
+// Carga
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <sys/mman.h>
+
+static const unsigned char *map_file(FILE *file, size_t size, int *mapped) {
+    void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    *mapped = 1;
+    return base == MAP_FAILED ? NULL : base;
+}
+
+static void unmap_file(const unsigned char *base, size_t size, int mapped) {
+    if (mapped) munmap((void *)base, size);
+    else free((void *)base);
+}
+
+#else
+
+static const unsigned char *map_file(FILE *file, size_t size, int *mapped) {
+    unsigned char *base = malloc(size);
+    *mapped = 0;
+    if (base && (fseek(file, 0, SEEK_SET) != 0 || fread(base, 1, size, file) != size)) {
+        free(base);
+        base = NULL;
+    }
+    return base;
+}
+
+static void unmap_file(const unsigned char *base, size_t size, int mapped) {
+    (void)size;
+    (void)mapped;
+    free((void *)base);
+}
+
+#endif
+
+// Las secciones caben en el archivo y cada registro apunta dentro del pool
+static int valid_document(const compiled_document_t *doc) {
+    const stc_header_t *header = doc->header;
+    if (header->version != STC_VERSION || header->byte_order != STC_BYTE_ORDER) return 0;
+
+    uint64_t size = doc->size;
+    if (header->dependencies_offset % 8 != 0 || header->records_offset % 4 != 0 ||
+        header->dependencies_offset + (uint64_t)header->dependency_count * sizeof(stc_dependency_t) > size ||
+        header->records_offset + (uint64_t)header->record_count * sizeof(stc_record_t) > size ||
+        header->pool_size == 0 || header->pool_offset + (uint64_t)header->pool_size > size ||
+        doc->pool[header->pool_size - 1] != '\0') {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < header->record_count; i++) {
+        const stc_record_t *record = &doc->records[i];
+        if (record->kind > STC_LEAVE || record->line_kind > STC_TEXT ||
+            record->text + (uint64_t)record->lead >= header->pool_size) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < header->dependency_count; i++) {
+        if (doc->dependencies[i].path >= header->pool_size) return 0;
+    }
+    return 1;
+}
+
+// Avisa de los archivos fuente que cambiaron desde la compilación y devuelve
+// cuántos son. Solo se leen los que cambiaron de tamaño o de fecha; los que ya no
+// existen no importan
+static int check_dependencies(const compiled_document_t *doc, const char *path) {
+    int changed = 0;
+    for (uint32_t i = 0; i < doc->header->dependency_count; i++) {
+        const stc_dependency_t *dependency = &doc->dependencies[i];
+        const char *source = doc->pool + dependency->path;
+        struct stat info;
+        if (stat(source, &info) != 0) continue;
+        if ((uint64_t)info.st_size == dependency->size && (int64_t)info.st_mtime == dependency->mtime) continue;
+
+        size_t length;
+        char *data = read_whole_file(source, &length);
+        if (data && (length != dependency->size || content_hash(data, length) != dependency->hash)) {
+            fprintf(stderr, "Error: '%s' cambió después de compilar '%s'; vuelva a ejecutar --compile\n",
+                    source, path);
+            changed++;
+        }
+        free(data);
+    }
+    return changed;
+}
+
+// Devuelve 0 si path no es un documento compilado (se procesa como fuente),
+// 1 si se cargó y -1, con el error avisado, si está dañado, es de otra versión o
+// alguno de sus fuentes cambió después de compilarlo
+int open_compiled_document(stroff_context_t *ctx, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return 0;
+
+    char magic[sizeof(STC_MAGIC)];
+    struct stat info;
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, STC_MAGIC, sizeof(magic)) != 0 ||
+        fstat(fileno(file), &info) != 0) {
+        fclose(file);
+        return 0;
+    }
+
+    size_t size = (size_t)info.st_size;
+    int mapped = 0;
+    const unsigned char *base = size >= sizeof(stc_header_t) ? map_file(file, size, &mapped) : NULL;
+    fclose(file);
+
+    compiled_document_t *doc = base ? malloc(sizeof(compiled_document_t)) : NULL;
+    if (doc) {
+        doc->base = base;
+        doc->size = size;
+        doc->mapped = mapped;
+        doc->header = (const stc_header_t *)base;
+        doc->dependencies = (const stc_dependency_t *)(base + doc->header->dependencies_offset);
+        doc->records = (const stc_record_t *)(base + doc->header->records_offset);
+        doc->pool = (const char *)(base + doc->header->pool_offset);
+    }
+    if (!doc || !valid_document(doc)) {
+        fprintf(stderr, "Error: '%s' no es un documento compilado válido para esta versión de stroff\n", path);
+        if (base) unmap_file(base, size, mapped);
+        free(doc);
+        return -1;
+    }
+
+    // Renderizar un .stc desfasado daría una salida que ya no corresponde a los fuentes
+    if (check_dependencies(doc, path) > 0) {
+        unmap_file(base, size, mapped);
+        free(doc);
+        return -1;
+    }
+    ctx->compiled = doc;
+    return 1;
+}
+
+// Equivale a procesar el documento fuente línea a línea: process_file() lo llama
+// en lugar de abrir el archivo principal
+void replay_compiled_document(stroff_context_t *ctx) {
+    const compiled_document_t *doc = ctx->compiled;
+    const char *pool = doc->pool;
+    int depth = ctx->include_depth;
+
+    for (uint32_t i = 0; i < doc->header->record_count && !ctx->stop_processing; i++) {
+        const stc_record_t *record = &doc->records[i];
+        const char *line = pool + record->text;
+
+        if (record->kind == STC_ENTER) {
+            if (!enter_compiled_include(ctx, line)) break;
+            continue;
+        }
+        if (record->kind == STC_LEAVE) {
+            leave_include(ctx);
+            continue;
+        }
+
+        // Bloques descartados, cuerpos de macro y código tratan la línea tal cual
+        if ((record->flags & STC_EXPAND) || ctx->cond_skip_from || ctx->recording_macro >= 0 ||
+            ctx->in_code_block) {
+            process_line(ctx, line);
+        } else if (record->line_kind == STC_COMMAND || record->line_kind == STC_TEXT) {
+            process_trimmed_line(ctx, line + record->lead);
+        }
+    }
+
+    // Al detenerse a mitad (vista previa) los archivos abiertos se cierran igual
+    while (ctx->include_depth > depth) {
+        leave_include(ctx);
+    }
+}
+
+void free_compiled_document(stroff_context_t *ctx) {
+    compiled_document_t *doc = ctx->compiled;
+    if (!doc) return;
+    unmap_file(doc->base, doc->size, doc->mapped);
+    free(doc);
+    ctx->compiled = NULL;
+}
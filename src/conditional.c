@@ -0,0 +1,132 @@
+#include "stroff.h"
+
+// Compilación condicional: .IF DEFINED(X) / .IF !DEFINED(X), .ELSE y .ENDIF. Se
+// evalúa al leer el documento; las líneas de un bloque descartado solo se miran
+// para encontrar su .ELSE/.ENDIF, sin expandir variables, ejecutar comandos ni
+// abrir .INCLUDE
+
+// ".IF", ".ELSE", ... seguido de espacio o fin de línea
+static int is_directive(const char *p, const char *name, int len) {
+    return strncmp(p, name, (size_t)len) == 0 && (p[len] == '\0' || isspace((unsigned char)p[len]));
+}
+
+static int evaluate_condition(stroff_context_t *ctx, const char *p) {
+    int negate = 0;
+
+    while (isspace((unsigned char)*p)) p++;
+    if (*p == '!') {
+        negate = 1;
+        p++;
+        while (isspace((unsigned char)*p)) p++;
+    }
+
+    const char *name = NULL;
+    int len = 0;
+    if (strncmp(p, "DEFINED(", 8) == 0) {
+        name = p + 8;
+        while (isalnum((unsigned char)name[len]) || name[len] == '_') len++;
+    }
+    if (!name || len == 0 || name[len] != ')') {
+        // Todas las pasadas leen las mismas líneas: basta con avisar en la primera
+        if (ctx->outline_only) {
+            report_error(ctx, "Condición de .IF no válida '%s'", p);
+        }
+        return 0;
+    }
+
+    int defined = lookup_define(ctx, name, len) != NULL;
+    return negate ? !defined : defined;
+}
+
+static void open_conditional(stroff_context_t *ctx) {
+    ctx->cond_depth++;
+    if (ctx->cond_depth <= MAX_COND_DEPTH) {
+        ctx->cond_else_seen[ctx->cond_depth - 1] = 0;
+    }
+}
+
+// Devuelve 1 si .ELSE es válido en el nivel actual y lo marca como visto
+static int take_else(stroff_context_t *ctx) {
+    if (ctx->cond_depth == 0) {
+        if (ctx->outline_only) {
+            report_error(ctx, ".ELSE sin .IF");
+        }
+        return 0;
+    }
+    if (ctx->cond_depth <= MAX_COND_DEPTH) {
+        if (ctx->cond_else_seen[ctx->cond_depth - 1]) {
+            if (ctx->outline_only) {
+                report_error(ctx, ".ELSE repetido en el mismo .IF");
+            }
+            return 0;
+        }
+        ctx->cond_else_seen[ctx->cond_depth - 1] = 1;
+    }
+    return 1;
+}
+
+// Línea ya recortada de un bloque que se procesa. Devuelve 1 si era .IF/.ELSE/.ENDIF
+int handle_conditional(stroff_context_t *ctx, const char *line) {
+    if (is_directive(line, ".IF", 3)) {
+        if (ctx->cond_depth >= MAX_COND_DEPTH && ctx->outline_only) {
+            report_error(ctx, "Demasiados .IF anidados (máximo %d)", MAX_COND_DEPTH);
+        }
+        open_conditional(ctx);
+        if (!evaluate_condition(ctx, line + 3)) {
+            ctx->cond_skip_from = ctx->cond_depth;
+        }
+        return 1;
+    }
+    if (is_directive(line, ".ELSE", 5)) {
+        // Se venía procesando la rama del .IF: la del .ELSE se salta
+        if (take_else(ctx)) {
+            ctx->cond_skip_from = ctx->cond_depth;
+        }
+        return 1;
+    }
+    if (is_directive(line, ".ENDIF", 6)) {
+        if (ctx->cond_depth == 0) {
+            if (ctx->outline_only) {
+                report_error(ctx, ".ENDIF sin .IF");
+            }
+        } else {
+            ctx->cond_depth--;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// Línea de un bloque descartado: solo cuenta el anidamiento hasta el .ELSE o
+// .ENDIF que lo cierra
+void skip_conditional_line(stroff_context_t *ctx, const char *line) {
+    const char *p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (p[0] != '.' || (p[1] != 'I' && p[1] != 'E')) return;
+
+    if (is_directive(p, ".IF", 3)) {
+        open_conditional(ctx);
+    } else if (is_directive(p, ".ELSE", 5)) {
+        if (ctx->cond_depth == ctx->cond_skip_from && take_else(ctx)) {
+            ctx->cond_skip_from = 0;
+        }
+    } else if (is_directive(p, ".ENDIF", 6)) {
+        if (ctx->cond_depth == ctx->cond_skip_from) {
+            ctx->cond_skip_from = 0;
+        }
+        ctx->cond_depth--;
+    }
+}
+
+void reset_conditionals(stroff_context_t *ctx) {
+    ctx->cond_depth = 0;
+    ctx->cond_skip_from = 0;
+}
+
+// Al terminar el documento principal no puede quedar ningún .IF abierto
+void check_conditionals_closed(stroff_context_t *ctx) {
+    if (ctx->cond_depth > 0) {
+        report_error(ctx, "%d .IF sin .ENDIF al final del documento", ctx->cond_depth);
+    }
+    reset_conditionals(ctx);
+}
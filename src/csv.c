@@ -0,0 +1,292 @@
+#include "stroff.h"
+#include <stdint.h>
+
+// .TABLEFILE: importa un CSV/TSV (comillas RFC 4180) fila a fila hacia los
+// renderers de tabla, sin pasar por el texto de .TR. La memoria usada no depende
+// del tamaño del archivo: un bloque de lectura, el registro actual y una fila
+
+#define CSV_CHUNK_SIZE 65536
+#define CSV_ONES 0x0101010101010101ULL
+#define CSV_HIGHS 0x8080808080808080ULL
+
+typedef struct {
+    FILE *file;
+    char delimiter;
+    char *buffer;
+    size_t length;
+    size_t pos;
+    char *record;           // Campos del registro actual, cada uno terminado en '\0'
+    size_t record_length;
+    size_t record_capacity;
+    int field_offsets[MAX_TABLE_COLS];
+    int field_lengths[MAX_TABLE_COLS];
+    int field_count;
+    int field_quoted;
+} csv_reader_t;
+
+// Bytes de v iguales a cero: el bit alto de cada uno queda activo
+static uint64_t csv_zero_bytes(uint64_t v) {
+    return (v - CSV_ONES) & ~v & CSV_HIGHS;
+}
+
+// Primer byte de [p, end) que sea delimitador, comilla o fin de línea. Compara
+// 8 bytes por iteración (SWAR) y localiza el byte exacto al final
+static const char *csv_scan_special(const char *p, const char *end, char delimiter) {
+    const uint64_t delim_mask = CSV_ONES * (unsigned char)delimiter;
+    const uint64_t quote_mask = CSV_ONES * (unsigned char)'"';
+    const uint64_t lf_mask = CSV_ONES * (unsigned char)'\n';
+    const uint64_t cr_mask = CSV_ONES * (unsigned char)'\r';
+
+    while (end - p >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        if (csv_zero_bytes(v ^ delim_mask) | csv_zero_bytes(v ^ quote_mask) |
+            csv_zero_bytes(v ^ lf_mask) | csv_zero_bytes(v ^ cr_mask)) {
+            break;
+        }
+        p += 8;
+    }
+
+    while (p < end && *p != delimiter && *p != '"' && *p != '\n' && *p != '\r') {
+        p++;
+    }
+    return p;
+}
+
+static int csv_fill(csv_reader_t *reader) {
+    reader->length = fread(reader->buffer, 1, CSV_CHUNK_SIZE, reader->file);
+    reader->pos = 0;
+    return reader->length > 0;
+}
+
+static void csv_append(csv_reader_t *reader, const char *text, size_t len) {
+    if (reader->record_length + len + 1 > reader->record_capacity) {
+        size_t capacity = reader->record_capacity ? reader->record_capacity : 1024;
+        while (capacity < reader->record_length + len + 1) {
+            capacity *= 2;
+        }
+        char *record = realloc(reader->record, capacity);
+        if (!record) {
+            fprintf(stderr, "Error: Memoria insuficiente para leer la tabla\n");
+            exit(1);
+        }
+        reader->record = record;
+        reader->record_capacity = capacity;
+    }
+    memcpy(reader->record + reader->record_length, text, len);
+    reader->record_length += len;
+}
+
+static void csv_end_field(csv_reader_t *reader, size_t *field_start) {
+    // Los saltos de línea dentro de comillas no caben en una celda: pasan a espacios
+    if (reader->field_quoted) {
+        for (size_t i = *field_start; i < reader->record_length; i++) {
+            if (reader->record[i] == '\n' || reader->record[i] == '\r') {
+                reader->record[i] = ' ';
+            }
+        }
+        reader->field_quoted = 0;
+    }
+
+    if (reader->field_count < MAX_TABLE_COLS) {
+        reader->field_offsets[reader->field_count] = (int)*field_start;
+        reader->field_lengths[reader->field_count] = (int)(reader->record_length - *field_start);
+    }
+    reader->field_count++;
+    csv_append(reader, "", 0);
+    reader->record[reader->record_length++] = '\0';
+    *field_start = reader->record_length;
+}
+
+typedef enum {
+    CSV_FIELD_START,
+    CSV_UNQUOTED,
+    CSV_QUOTED,
+    CSV_QUOTE_IN_QUOTED     // Comilla dentro de un campo entre comillas: "" o cierre
+} csv_state_t;
+
+// Lee el siguiente registro; devuelve 0 al final del archivo. Se saltan las líneas
+// sin ningún byte aparte del salto de línea; "" es un registro con un campo vacío
+static int csv_next_record(csv_reader_t *reader) {
+    for (;;) {
+        csv_state_t state = CSV_FIELD_START;
+        size_t field_start = 0;
+        int content = 0;        // La línea tiene algo más que el salto de línea
+        reader->record_length = 0;
+        reader->field_count = 0;
+        reader->field_quoted = 0;
+
+        for (;;) {
+            if (reader->pos == reader->length && !csv_fill(reader)) {
+                // Fin de archivo: el último registro puede no terminar en salto de línea
+                if (!content) return 0;
+                csv_end_field(reader, &field_start);
+                return 1;
+            }
+
+            const char *p = reader->buffer + reader->pos;
+            const char *end = reader->buffer + reader->length;
+
+            if (state == CSV_FIELD_START) {
+                if (*p == '"') {
+                    content = 1;
+                    state = CSV_QUOTED;
+                    reader->field_quoted = 1;
+                    reader->pos++;
+                    continue;
+                }
+                state = CSV_UNQUOTED;
+            }
+
+            if (state == CSV_QUOTED) {
+                const char *quote = memchr(p, '"', (size_t)(end - p));
+                if (!quote) {
+                    csv_append(reader, p, (size_t)(end - p));
+                    reader->pos = reader->length;
+                    continue;
+                }
+                csv_append(reader, p, (size_t)(quote - p));
+                reader->pos += (size_t)(quote - p) + 1;
+                state = CSV_QUOTE_IN_QUOTED;
+                continue;
+            }
+
+            if (state == CSV_QUOTE_IN_QUOTED) {
+                if (*p == '"') {
+                    csv_append(reader, "\"", 1);
+                    reader->pos++;
+                    state = CSV_QUOTED;
+                    continue;
+                }
+                // Campo cerrado: lo que siga hasta el delimitador se añade tal cual
+                state = CSV_UNQUOTED;
+            }
+
+            const char *stop = csv_scan_special(p, end, reader->delimiter);
+            csv_append(reader, p, (size_t)(stop - p));
+            reader->pos += (size_t)(stop - p);
+            if (stop > p) content = 1;
+            if (stop == end) continue;
+
+            char c = *stop;
+            reader->pos++;
+            if (c == reader->delimiter) {
+                content = 1;
+                csv_end_field(reader, &field_start);
+                state = CSV_FIELD_START;
+            } else if (c == '\n') {
+                csv_end_field(reader, &field_start);
+                break;
+            } else if (c == '"') {
+                // Comilla suelta en un campo sin comillas: se conserva
+                content = 1;
+                csv_append(reader, "\"", 1);
+            }
+            // '\r' de CRLF: se descarta
+        }
+
+        if (content) {
+            return 1;
+        }
+    }
+}
+
+static int csv_open(csv_reader_t *reader, const char *path, char delimiter) {
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(path, "rb");
+    if (!reader->file) return 0;
+
+    reader->delimiter = delimiter;
+    reader->buffer = malloc(CSV_CHUNK_SIZE);
+    if (!reader->buffer) {
+        fprintf(stderr, "Error: Memoria insuficiente para leer la tabla\n");
+        exit(1);
+    }
+    return 1;
+}
+
+static void csv_rewind(csv_reader_t *reader) {
+    rewind(reader->file);
+    reader->length = 0;
+    reader->pos = 0;
+}
+
+static void csv_close(csv_reader_t *reader) {
+    fclose(reader->file);
+    free(reader->buffer);
+    free(reader->record);
+}
+
+static int csv_field_count(const csv_reader_t *reader) {
+    return reader->field_count < MAX_TABLE_COLS ? reader->field_count : MAX_TABLE_COLS;
+}
+
+static void csv_store_record(const csv_reader_t *reader, table_t *table, int row) {
+    int count = csv_field_count(reader);
+    for (int col = 0; col < count && col < table->cols; col++) {
+        table_set_cell(table, row, col, reader->record + reader->field_offsets[col], reader->field_lengths[col]);
+    }
+}
+
+// La tabla llega configurada desde .TABLEFILE (COLS, WIDTHS, ALIGNS, NAME).
+// Con WIDTHS=AUTO el archivo se recorre dos veces: una para medir y otra para renderizar
+void import_table_file(stroff_context_t *ctx, const char *path, char delimiter, int has_header) {
+    table_t *table = &ctx->current_table;
+    csv_reader_t reader;
+
+    if (!csv_open(&reader, path, delimiter)) {
+        fprintf(stderr, "Error: No se puede abrir el archivo de tabla '%s'\n", path);
+        table_reset(table, 0);
+        return;
+    }
+
+    if (!csv_next_record(&reader)) {
+        csv_close(&reader);
+        table_reset(table, 0);
+        return;
+    }
+
+    // Sin COLS: tantas columnas como campos tenga el primer registro
+    if (table->cols == 0) {
+        table_set_cols(table, csv_field_count(&reader));
+    }
+
+    if (table->auto_widths) {
+        int natural[MAX_TABLE_COLS] = {0};
+        do {
+            int count = csv_field_count(&reader);
+            for (int col = 0; col < count && col < table->cols; col++) {
+                int width = utf8_display_width(reader.record + reader.field_offsets[col]);
+                if (width > natural[col]) natural[col] = width;
+            }
+        } while (csv_next_record(&reader));
+
+        fit_table_columns(ctx, table, natural);
+        csv_rewind(&reader);
+        csv_next_record(&reader);
+    }
+
+    // HEADER=1: cabecera con su TLINE, que se repite en cada página
+    if (has_header) {
+        csv_store_record(&reader, table, -1);
+        table_add_rule(table);
+    }
+
+    render_table_begin(ctx, table);
+    if (table_has_headers(table) && table_has_rule_after(table, -1)) {
+        render_table_rule(ctx, table);
+    }
+
+    int more = has_header ? csv_next_record(&reader) : 1;
+    while (more) {
+        table_clear_rows(table);
+        int row = table_add_row(table);
+        csv_store_record(&reader, table, row);
+        render_table_row(ctx, table, row);
+        more = csv_next_record(&reader);
+    }
+
+    render_table_end(ctx, table);
+    csv_close(&reader);
+    table_reset(table, 0);
+}
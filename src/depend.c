@@ -0,0 +1,72 @@
+#include "stroff.h"
+
+// -M: dependencias del documento en sintaxis de Makefile. El recorrido previo
+// anota la ruta resuelta de cada archivo que abre (.INCLUDE y .TABLEFILE); los
+// bloques descartados por .IF no abren archivos y no cuentan
+
+void add_dependency(stroff_context_t *ctx, const char *path) {
+    for (int i = 0; i < ctx->dependency_count; i++) {
+        if (strcmp(ctx->dependencies[i], path) == 0) return;
+    }
+
+    if (ctx->dependency_count == ctx->dependency_capacity) {
+        int capacity = ctx->dependency_capacity ? ctx->dependency_capacity * 2 : 16;
+        char **grown = realloc(ctx->dependencies, sizeof(char *) * (size_t)capacity);
+        if (!grown) return;
+        ctx->dependencies = grown;
+        ctx->dependency_capacity = capacity;
+    }
+
+    size_t len = strlen(path) + 1;
+    char *copy = malloc(len);
+    if (!copy) return;
+    memcpy(copy, path, len);
+    ctx->dependencies[ctx->dependency_count++] = copy;
+}
+
+// Espacios, '#' y '$' se escapan como lo espera make
+static void write_make_path(FILE *file, const char *path) {
+    for (const char *p = path; *p; p++) {
+        if (*p == ' ' || *p == '#') fputc('\\', file);
+        else if (*p == '$') fputc('$', file);
+        fputc(*p, file);
+    }
+}
+
+// target: dep1 dep2 ..., y una regla vacía por cada dependencia para que make no
+// falle si un archivo incluido deja de existir
+int write_depfile(stroff_context_t *ctx, const char *path, const char *target) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: No se puede escribir el archivo de dependencias '%s'\n", path);
+        return 0;
+    }
+
+    write_make_path(file, target);
+    fputc(':', file);
+    for (int i = 0; i < ctx->dependency_count; i++) {
+        fputs(" \\\n  ", file);
+        write_make_path(file, ctx->dependencies[i]);
+    }
+    fputc('\n', file);
+
+    // El documento principal no necesita regla vacía: sin él no hay nada que construir
+    for (int i = 1; i < ctx->dependency_count; i++) {
+        fputc('\n', file);
+        write_make_path(file, ctx->dependencies[i]);
+        fputs(":\n", file);
+    }
+
+    fclose(file);
+    return 1;
+}
+
+void free_dependencies(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->dependency_count; i++) {
+        free(ctx->dependencies[i]);
+    }
+    free(ctx->dependencies);
+    ctx->dependencies = NULL;
+    ctx->dependency_count = 0;
+    ctx->dependency_capacity = 0;
+}
@@ -1,7 +1,28 @@
 #include "stroff.h"
 
+// Estimación barata para vistas previas: líneas según el ancho total del texto,
+// sin partir palabras ni construir líneas
+static void estimate_wrapped_lines(stroff_context_t *ctx, const char *text, int available_width, int line_space) {
+    int width = utf8_display_width(text);
+    if (available_width < 1) available_width = 1;
+
+    int lines = (width + available_width - 1) / available_width;
+    for (int i = 0; i < lines; i++) {
+        check_page_break(ctx, line_space);
+        ctx->current_line += line_space;
+    }
+}
+
 void output_text(stroff_context_t *ctx, const char *text, align_t align) {
-    int content_width = ctx->params.page_width - ctx->params.left_margin - ctx->params.right_margin;
+    int content_width = ctx->geometry.content_width;
+
+    if (ctx->layout_mode == LAYOUT_SKIP) return;
+    if (ctx->layout_mode == LAYOUT_ESTIMATE) {
+        estimate_wrapped_lines(ctx, text, content_width, ctx->params.line_space);
+        ctx->first_line_of_paragraph = 0;
+        return;
+    }
+
     char words[MAX_LINE_LENGTH][MAX_LINE_LENGTH];
     int word_count = 0;
 
@@ -39,8 +60,21 @@ void output_text(stroff_context_t *ctx, const char *text, align_t align) {
             int word_len = strlen(words[current_word]);
             int needed = word_len + (line_word_count > 0 ? 1 : 0); // +1 para espacio
 
-            if (line_length + needed > available_width && line_word_count > 0) {
-                break; // No cabe más en esta línea
+            if (line_length + needed > available_width) {
+                // Con división silábica, la parte de la palabra que quepa se queda en esta línea
+                int room = available_width - line_length - (line_word_count > 0 ? 1 : 0);
+                int split = hyphen_split_point(ctx, words[current_word], room);
+                if (split > 0) {
+                    memcpy(line_words[line_word_count], words[current_word], split);
+                    strcpy(line_words[line_word_count] + split, "-");
+                    line_length += split + 1 + (line_word_count > 0 ? 1 : 0);
+                    line_word_count++;
+                    memmove(words[current_word], words[current_word] + split, word_len - split + 1);
+                    break;
+                }
+                if (line_word_count > 0) {
+                    break; // No cabe más en esta línea
+                }
             }
 
             strcpy(line_words[line_word_count], words[current_word]);
@@ -49,16 +83,14 @@ void output_text(stroff_context_t *ctx, const char *text, align_t align) {
             current_word++;
         }
 
+        check_page_break(ctx, ctx->params.line_space);
+
         // Imprimir margen izquierdo
-        for (int i = 0; i < ctx->params.left_margin; i++) {
-            fprintf(ctx->output, " ");
-        }
+        output_spaces(ctx, ctx->params.left_margin);
 
         // Aplicar indentación solo en la primera línea del párrafo
         if (first_line_of_paragraph) {
-            for (int i = 0; i < ctx->params.indent; i++) {
-                fprintf(ctx->output, " ");
-            }
+            output_spaces(ctx, ctx->params.indent);
             ctx->first_line_of_paragraph = 0; // Solo primera línea
         }
 
@@ -70,12 +102,10 @@ void output_text(stroff_context_t *ctx, const char *text, align_t align) {
                 if (i < line_word_count - 1) total_text_len++;
             }
             int padding = (available_width - total_text_len) / 2;
-            for (int i = 0; i < padding; i++) {
-                fprintf(ctx->output, " ");
-            }
+            output_spaces(ctx, padding);
             for (int i = 0; i < line_word_count; i++) {
-                fprintf(ctx->output, "%s", line_words[i]);
-                if (i < line_word_count - 1) fprintf(ctx->output, " ");
+                output_string(ctx, line_words[i]);
+                if (i < line_word_count - 1) output_spaces(ctx, 1);
             }
         } else if (align == ALIGN_RIGHT) {
             int total_text_len = 0;
@@ -84,12 +114,10 @@ void output_text(stroff_context_t *ctx, const char *text, align_t align) {
                 if (i < line_word_count - 1) total_text_len++;
             }
             int padding = available_width - total_text_len;
-            for (int i = 0; i < padding; i++) {
-                fprintf(ctx->output, " ");
-            }
+            output_spaces(ctx, padding);
             for (int i = 0; i < line_word_count; i++) {
-                fprintf(ctx->output, "%s", line_words[i]);
-                if (i < line_word_count - 1) fprintf(ctx->output, " ");
+                output_string(ctx, line_words[i]);
+                if (i < line_word_count - 1) output_spaces(ctx, 1);
             }
         } else if (align == ALIGN_FULL && line_word_count > 1 && current_word < word_count) {
             // Justificación completa solo si no es la última línea
@@ -105,35 +133,27 @@ void output_text(stroff_context_t *ctx, const char *text, align_t align) {
                 int extra_spaces = total_spaces % gaps;
 
                 for (int i = 0; i < line_word_count; i++) {
-                    fprintf(ctx->output, "%s", line_words[i]);
+                    output_string(ctx, line_words[i]);
                     if (i < line_word_count - 1) {
-                        for (int j = 0; j < spaces_per_gap; j++) {
-                            fprintf(ctx->output, " ");
-                        }
-                        if (i < extra_spaces) {
-                            fprintf(ctx->output, " ");
-                        }
+                        output_spaces(ctx, spaces_per_gap + (i < extra_spaces ? 1 : 0));
                     }
                 }
             } else {
-                fprintf(ctx->output, "%s", line_words[0]);
+                output_string(ctx, line_words[0]);
             }
         } else {
             // Alineación izquierda o última línea de justificada
             for (int i = 0; i < line_word_count; i++) {
-                fprintf(ctx->output, "%s", line_words[i]);
-                if (i < line_word_count - 1) fprintf(ctx->output, " ");
+                output_string(ctx, line_words[i]);
+                if (i < line_word_count - 1) output_spaces(ctx, 1);
             }
         }
 
-        check_page_break(ctx, ctx->params.line_space);
-        fprintf(ctx->output, "\n");
-        ctx->current_line++;
+        output_newline(ctx);
 
+        // El interlineado ya se reservó junto con la línea
         for (int i = 1; i < ctx->params.line_space; i++) {
-            check_page_break(ctx, 1);
-            fprintf(ctx->output, "\n");
-            ctx->current_line++;
+            output_newline(ctx);
         }
     }
 
@@ -141,10 +161,16 @@ void output_text(stroff_context_t *ctx, const char *text, align_t align) {
 }
 
 void output_list_item(stroff_context_t *ctx, const char *prefix, const char *text) {
-    int content_width = ctx->params.page_width - ctx->params.left_margin - ctx->params.right_margin;
+    int content_width = ctx->geometry.content_width;
     int list_base_margin = ctx->params.left_margin + ctx->current_list.indent;
     int prefix_len = strlen(prefix);
 
+    if (ctx->layout_mode == LAYOUT_SKIP) return;
+    if (ctx->layout_mode == LAYOUT_ESTIMATE) {
+        estimate_wrapped_lines(ctx, text, content_width - ctx->current_list.indent - prefix_len, 1);
+        return;
+    }
+
     char words[MAX_LINE_LENGTH][MAX_LINE_LENGTH];
     int word_count = 0;
 
@@ -193,132 +219,96 @@ void output_list_item(stroff_context_t *ctx, const char *prefix, const char *tex
             current_word++;
         }
 
+        check_page_break(ctx, 1);
+
         // Imprimir margen izquierdo
-        for (int i = 0; i < list_base_margin; i++) {
-            fprintf(ctx->output, " ");
-        }
+        output_spaces(ctx, list_base_margin);
 
         // Imprimir prefijo solo en primera línea
         if (is_first_line) {
-            fprintf(ctx->output, "%s", prefix);
+            output_string(ctx, prefix);
             is_first_line = 0;
         } else {
             // En líneas siguientes, alinear con el texto (después del prefijo)
-            for (int i = 0; i < prefix_len; i++) {
-                fprintf(ctx->output, " ");
-            }
+            output_spaces(ctx, prefix_len);
         }
 
         // Imprimir palabras de la línea
         for (int i = 0; i < line_word_count; i++) {
-            fprintf(ctx->output, "%s", line_words[i]);
-            if (i < line_word_count - 1) fprintf(ctx->output, " ");
+            output_string(ctx, line_words[i]);
+            if (i < line_word_count - 1) output_spaces(ctx, 1);
         }
 
-        check_page_break(ctx, 1);
-        fprintf(ctx->output, "\n");
-        ctx->current_line++;
+        output_newline(ctx);
     }
 
     free(text_copy);
 }
 
-void output_header(stroff_context_t *ctx) {
-    if (strlen(ctx->params.header) == 0) return;
-
-    char header_text[MAX_TITLE_LENGTH];
-    strcpy(header_text, ctx->params.header);
-    substitute_variables(ctx, header_text);
+static void output_aligned_template(stroff_context_t *ctx, const text_template_t *tpl, align_t align) {
+    char text[MAX_LINE_LENGTH];
+    int text_len = render_template(ctx, tpl, text, sizeof(text));
+    int content_width = ctx->geometry.content_width;
 
-    // Output header without page break checking to avoid recursion
-    int content_width = ctx->params.page_width - ctx->params.left_margin - ctx->params.right_margin;
-    int text_len = strlen(header_text);
-
-    for (int i = 0; i < ctx->params.left_margin; i++) {
-        fprintf(ctx->output, " ");
+    int padding = 0;
+    if (align == ALIGN_CENTER) {
+        padding = (content_width - text_len) / 2;
+    } else if (align == ALIGN_RIGHT) {
+        padding = content_width - text_len;
     }
 
-    if (ctx->params.head_align == ALIGN_CENTER) {
-        int padding = (content_width - text_len) / 2;
-        for (int i = 0; i < padding; i++) {
-            fprintf(ctx->output, " ");
-        }
-        fprintf(ctx->output, "%s", header_text);
-    } else if (ctx->params.head_align == ALIGN_RIGHT) {
-        int padding = content_width - text_len;
-        for (int i = 0; i < padding; i++) {
-            fprintf(ctx->output, " ");
-        }
-        fprintf(ctx->output, "%s", header_text);
-    } else {
-        fprintf(ctx->output, "%s", header_text);
-    }
-
-    fprintf(ctx->output, "\n");
+    output_spaces(ctx, ctx->params.left_margin);
+    output_spaces(ctx, padding);
+    output_raw(ctx, text, text_len);
+    output_raw(ctx, "\n", 1);
 }
 
-void output_footer(stroff_context_t *ctx) {
-    if (strlen(ctx->params.footer) == 0) return;
-
-    char footer_text[MAX_TITLE_LENGTH];
-    strcpy(footer_text, ctx->params.footer);
-    substitute_variables(ctx, footer_text);
-
-    // Output footer without page break checking to avoid recursion
-    int content_width = ctx->params.page_width - ctx->params.left_margin - ctx->params.right_margin;
-    int text_len = strlen(footer_text);
+void output_header(stroff_context_t *ctx) {
+    if (ctx->header_template.segment_count == 0) return;
 
-    fprintf(ctx->output, "\n");
+    // Slot de header: se escribe sin contar líneas (reservadas en ctx->geometry)
+    output_aligned_template(ctx, &ctx->header_template, ctx->params.head_align);
+}
 
-    for (int i = 0; i < ctx->params.left_margin; i++) {
-        fprintf(ctx->output, " ");
-    }
+void output_footer(stroff_context_t *ctx) {
+    if (ctx->footer_template.segment_count == 0) return;
 
-    if (ctx->params.foot_align == ALIGN_CENTER) {
-        int padding = (content_width - text_len) / 2;
-        for (int i = 0; i < padding; i++) {
-            fprintf(ctx->output, " ");
-        }
-        fprintf(ctx->output, "%s", footer_text);
-    } else if (ctx->params.foot_align == ALIGN_RIGHT) {
-        int padding = content_width - text_len;
-        for (int i = 0; i < padding; i++) {
-            fprintf(ctx->output, " ");
-        }
-        fprintf(ctx->output, "%s", footer_text);
-    } else {
-        fprintf(ctx->output, "%s", footer_text);
-    }
+    // Slot de footer: línea en blanco, footer y separación con la página siguiente.
+    // Se escribe sin contar líneas: su espacio ya está reservado en ctx->geometry
+    output_raw(ctx, "\n", 1);
+    output_aligned_template(ctx, &ctx->footer_template, ctx->params.foot_align);
+    output_raw(ctx, "\n", 1);
+}
 
-    fprintf(ctx->output, "\n");
+static void output_page_field(stroff_context_t *ctx, fixup_kind_t kind, int index, int page) {
+    char field[16];
+    record_page_fixup(ctx, kind, index);
+    snprintf(field, sizeof(field), "%*d", PAGE_NUMBER_WIDTH, page);
+    output_string(ctx, field);
 }
 
 void output_toc(stroff_context_t *ctx) {
     check_page_break(ctx, 3 + ctx->chapter_count + 2);
-    fprintf(ctx->output, "\nTABLA DE CONTENIDOS\n");
-    ctx->current_line++;
-    fprintf(ctx->output, "==================\n\n");
-    ctx->current_line += 2;
+    output_newline(ctx);
+    output_string(ctx, "TABLA DE CONTENIDOS");
+    output_newline(ctx);
+    output_string(ctx, "==================");
+    output_newline(ctx);
+    output_newline(ctx);
 
     for (int i = 0; i < ctx->chapter_count; i++) {
         check_page_break(ctx, 1);
 
-        for (int j = 0; j < ctx->params.left_margin; j++) {
-            fprintf(ctx->output, " ");
-        }
-
-        for (int j = 1; j < ctx->chapters[i].level; j++) {
-            fprintf(ctx->output, "  ");
-        }
-
-        fprintf(ctx->output, "%s", ctx->chapters[i].title);
+        output_spaces(ctx, ctx->params.left_margin);
+        output_spaces(ctx, (ctx->chapters[i].level - 1) * 2);
+        output_string(ctx, ctx->chapters[i].title);
 
         // Estrategia de posición fija: números siempre en la misma columna
-        int content_width = ctx->params.page_width - ctx->params.left_margin - ctx->params.right_margin;
+        int content_width = ctx->geometry.content_width;
         int title_width = utf8_display_width(ctx->chapters[i].title) + (ctx->chapters[i].level - 1) * 2;
 
         // Posición fija para números: 4 caracteres desde el final (espacio para números hasta 999)
-        int number_field_width = 4;  // "  99" o " 123"
+        int number_field_width = PAGE_NUMBER_WIDTH;  // "  99" o " 123"
         int dots_start_pos = title_width;
         int dots_end_pos = content_width - number_field_width;
 
@@ -328,50 +318,39 @@ void output_toc(stroff_context_t *ctx) {
 
         // Imprimir puntos
         for (int j = 0; j < dots_needed; j++) {
-            fprintf(ctx->output, ".");
-        }
-
-        // Imprimir número con padding a la derecha
-        char page_str[16];
-        snprintf(page_str, sizeof(page_str), "%d", ctx->chapters[i].page);
-        int page_len = strlen(page_str);
-        int padding = number_field_width - page_len;
-
-        for (int j = 0; j < padding; j++) {
-            fprintf(ctx->output, " ");
+            output_raw(ctx, ".", 1);
         }
 
-        fprintf(ctx->output, "%s\n", page_str);
-        ctx->current_line++;
+        // Imprimir número con padding a la derecha (campo reservado, se rellena al final)
+        output_page_field(ctx, FIXUP_CHAPTER, i, ctx->chapters[i].page);
+        output_newline(ctx);
     }
 
     check_page_break(ctx, 1);
-    fprintf(ctx->output, "\n");
-    ctx->current_line++;
+    output_newline(ctx);
 }
 
 void output_tot(stroff_context_t *ctx) {
     check_page_break(ctx, 3 + ctx->table_ref_count + 2);
-    fprintf(ctx->output, "\nINDICE DE TABLAS\n");
-    ctx->current_line++;
-    fprintf(ctx->output, "================\n\n");
-    ctx->current_line += 2;
+    output_newline(ctx);
+    output_string(ctx, "INDICE DE TABLAS");
+    output_newline(ctx);
+    output_string(ctx, "================");
+    output_newline(ctx);
+    output_newline(ctx);
 
     for (int i = 0; i < ctx->table_ref_count; i++) {
         check_page_break(ctx, 1);
 
-        for (int j = 0; j < ctx->params.left_margin; j++) {
-            fprintf(ctx->output, " ");
-        }
-
-        fprintf(ctx->output, "%s", ctx->table_refs[i].name);
+        output_spaces(ctx, ctx->params.left_margin);
+        output_string(ctx, ctx->table_refs[i].name);
 
         // Estrategia de posición fija: números siempre en la misma columna
-        int content_width = ctx->params.page_width - ctx->params.left_margin - ctx->params.right_margin;
+        int content_width = ctx->geometry.content_width;
         int name_width = strlen(ctx->table_refs[i].name);
 
         // Posición fija para números: 4 caracteres desde el final
-        int number_field_width = 4;
+        int number_field_width = PAGE_NUMBER_WIDTH;
         int dots_start_pos = name_width;
         int dots_end_pos = content_width - number_field_width;
 
@@ -381,137 +360,568 @@ void output_tot(stroff_context_t *ctx) {
 
         // Imprimir puntos
         for (int j = 0; j < dots_needed; j++) {
-            fprintf(ctx->output, ".");
+            output_raw(ctx, ".", 1);
         }
 
-        // Imprimir número con padding a la derecha
-        char page_str[16];
-        snprintf(page_str, sizeof(page_str), "%d", ctx->table_refs[i].page);
-        int page_len = strlen(page_str);
-        int padding = number_field_width - page_len;
+        // Imprimir número con padding a la derecha (campo reservado, se rellena al final)
+        output_page_field(ctx, FIXUP_TABLE, i, ctx->table_refs[i].page);
+        output_newline(ctx);
+    }
 
-        for (int j = 0; j < padding; j++) {
-            fprintf(ctx->output, " ");
-        }
+    check_page_break(ctx, 1);
+    output_newline(ctx);
+}
 
-        fprintf(ctx->output, "%s\n", page_str);
-        ctx->current_line++;
-    }
+void output_line(stroff_context_t *ctx, const char *text) {
+    check_page_break(ctx, 1);
+    output_string(ctx, text);
+    output_newline(ctx);
+}
+
+// Backend de texto: maquetación de ancho fijo sobre el modelo de páginas
 
+static void text_begin_document(stroff_context_t *ctx, render_target_t *target) {
+    (void)target;
+    ctx->current_line = 0;
+    start_page(ctx);
+
+    output_newline(ctx);
+    if (strlen(ctx->params.title) > 0) {
+        output_text(ctx, ctx->params.title, ALIGN_CENTER);
+        check_page_break(ctx, 1);
+        output_newline(ctx);
+    }
+    if (strlen(ctx->params.author) > 0) {
+        output_text(ctx, ctx->params.author, ALIGN_CENTER);
+        check_page_break(ctx, 1);
+        output_newline(ctx);
+    }
+    if (strlen(ctx->params.date) > 0) {
+        output_text(ctx, ctx->params.date, ALIGN_CENTER);
+        check_page_break(ctx, 1);
+        output_newline(ctx);
+    }
     check_page_break(ctx, 1);
-    fprintf(ctx->output, "\n");
-    ctx->current_line++;
+    output_newline(ctx);
+}
+
+static void text_end_document(stroff_context_t *ctx, render_target_t *target) {
+    (void)target;
+    // Procesar la última página antes de cerrar documento
+    finish_page(ctx);
 }
 
-void new_page(stroff_context_t *ctx) {
-    // Agregar footer de la página actual si está configurado
-    if (strlen(ctx->params.footer) > 0) {
-        // Llenar líneas hasta el final de la página
-        while (ctx->current_line < ctx->params.page_height - 3) {
-            fprintf(ctx->output, "\n");
-            ctx->current_line++;
+static void text_heading(stroff_context_t *ctx, render_target_t *target, const char *title, int level, int index) {
+    (void)target;
+    (void)index;
+
+    output_newline(ctx);
+    output_string(ctx, title);
+    output_newline(ctx);
+    if (level < 3) {
+        const char *underline = level == 1 ? "=" : "-";
+        for (size_t i = 0; i < strlen(title); i++) {
+            output_raw(ctx, underline, 1);
         }
-        output_footer(ctx);
+        output_newline(ctx);
+    }
+    output_newline(ctx);
+}
+
+static void text_paragraph(stroff_context_t *ctx, render_target_t *target, align_t align) {
+    (void)target;
+    (void)align;
+    check_page_break(ctx, 1);
+    output_newline(ctx);
+}
+
+static void text_text(stroff_context_t *ctx, render_target_t *target, const char *text, align_t align) {
+    (void)target;
+    output_text(ctx, text, align);
+}
+
+static void text_blank_line(stroff_context_t *ctx, render_target_t *target) {
+    (void)target;
+    output_blank_line(ctx);
+}
+
+static void text_line_break(stroff_context_t *ctx, render_target_t *target) {
+    (void)target;
+    check_page_break(ctx, 1);
+    output_newline(ctx);
+}
+
+static void text_list_begin(stroff_context_t *ctx, render_target_t *target, list_type_t type) {
+    (void)type;
+    text_blank_line(ctx, target);
+}
+
+static void text_list_item(stroff_context_t *ctx, render_target_t *target, const char *prefix, const char *text) {
+    (void)target;
+    output_list_item(ctx, prefix, text);
+}
+
+static void output_table_segment(stroff_context_t *ctx, const char *text, int len, int text_width,
+                                 int width, align_t align) {
+    if (align == ALIGN_CENTER && width > text_width) {
+        int padding = (width - text_width) / 2;
+        output_spaces(ctx, padding);
+        output_raw(ctx, text, len);
+        output_spaces(ctx, width - text_width - padding);
+    } else if (align == ALIGN_RIGHT && width > text_width) {
+        output_spaces(ctx, width - text_width);
+        output_raw(ctx, text, len);
     } else {
-        // Sin footer, llenar hasta el final completo
-        while (ctx->current_line < ctx->params.page_height - 1) {
-            fprintf(ctx->output, "\n");
-            ctx->current_line++;
+        output_raw(ctx, text, len);
+        output_spaces(ctx, width - text_width);
+    }
+}
+
+static int utf8_char_length(unsigned char c) {
+    if (c < 0xC0) return 1;
+    if (c < 0xE0) return 2;
+    if (c < 0xF0) return 3;
+    return 4;
+}
+
+// Siguiente trozo de una celda que cabe en width columnas: corta en el último
+// espacio y, si una palabra sola no cabe, dentro de la palabra
+static const char *next_cell_segment(const char *text, int width, int *seg_len, int *seg_width) {
+    while (*text == ' ') text++;
+
+    const char *p = text;
+    int used = 0;
+    int break_len = -1;
+    int break_width = 0;
+
+    while (*p) {
+        if (*p == ' ') {
+            break_len = (int)(p - text);
+            break_width = used;
         }
+        if (used == width) break;
+        p += utf8_char_length((unsigned char)*p);
+        used++;
     }
 
-    // Salto de página sin caracteres especiales
-    fprintf(ctx->output, "\n");
+    if (*p && *p != ' ' && break_len > 0) {
+        *seg_len = break_len;
+        *seg_width = break_width;
+        return text + break_len;
+    }
 
-    // Cambiar a nueva página
-    ctx->current_page++;
-    ctx->current_line = 0;
+    *seg_len = (int)(p - text);
+    *seg_width = used;
+    return p;
+}
+
+static int table_row_fits(const table_t *table, int row) {
+    for (int col = 0; col < table->cols; col++) {
+        if (table_cell_width(table, row, col) > table->widths[col]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Líneas que ocupa una fila una vez partidas sus celdas
+static int table_row_height(const table_t *table, int row) {
+    if (table_row_fits(table, row)) return 1;
+
+    int height = 1;
+    for (int col = 0; col < table->cols; col++) {
+        int width = table->widths[col] > 0 ? table->widths[col] : 1;
+        const char *rest = table_cell(table, row, col);
+        int lines = 0;
+        int seg_len;
+        int seg_width;
+
+        while (*rest == ' ') rest++;
+        while (*rest) {
+            rest = next_cell_segment(rest, width, &seg_len, &seg_width);
+            while (*rest == ' ') rest++;
+            lines++;
+        }
+        if (lines > height) height = lines;
+    }
+    return height;
+}
+
+// Fila de celdas con el ancho y la alineación de cada columna (sin marcos verticales).
+// Los anchos de las celdas se midieron al leerlas; solo las que no caben se parten
+static void text_table_cells(stroff_context_t *ctx, const table_t *table, int row) {
+    if (table_row_fits(table, row)) {
+        output_spaces(ctx, ctx->params.left_margin);
+        for (int col = 0; col < table->cols; col++) {
+            const char *cell = table_cell(table, row, col);
+            output_table_segment(ctx, cell, (int)strlen(cell), table_cell_width(table, row, col),
+                                 table->widths[col], table->aligns[col]);
+
+            // Espaciado entre columnas
+            if (col < table->cols - 1) {
+                output_spaces(ctx, 2);
+            }
+        }
+        output_newline(ctx);
+        return;
+    }
+
+    // Celdas más anchas que su columna: varias líneas por fila
+    const char *rest[MAX_TABLE_COLS];
+    for (int col = 0; col < table->cols; col++) {
+        rest[col] = table_cell(table, row, col);
+    }
 
-    // Agregar header de la nueva página (solo en capítulos)
-    if (strlen(ctx->params.header) > 0 && ctx->in_chapters) {
-        output_header(ctx);
-        fprintf(ctx->output, "\n");
-        ctx->current_line++;
+    // La fila se reservó entera; solo se corta si es más alta que una página
+    int pending = 1;
+    while (pending) {
+        pending = 0;
+        check_page_break(ctx, 1);
+        output_spaces(ctx, ctx->params.left_margin);
+
+        for (int col = 0; col < table->cols; col++) {
+            int width = table->widths[col] > 0 ? table->widths[col] : 1;
+            int seg_len;
+            int seg_width;
+            const char *segment = rest[col];
+            rest[col] = next_cell_segment(segment, width, &seg_len, &seg_width);
+            while (*segment == ' ') segment++;
+
+            output_table_segment(ctx, segment, seg_len, seg_width, table->widths[col], table->aligns[col]);
+            if (col < table->cols - 1) {
+                output_spaces(ctx, 2);
+            }
+
+            while (*rest[col] == ' ') rest[col]++;
+            if (*rest[col]) pending = 1;
+        }
+        output_newline(ctx);
     }
 }
 
-void check_page_break(stroff_context_t *ctx, int lines_needed) {
-    if (ctx->params.page_height > 0) {
-        // Reservar espacio para header y footer
-        int header_lines = (strlen(ctx->params.header) > 0) ? 2 : 0;
-        int footer_lines = (strlen(ctx->params.footer) > 0) ? 3 : 0;
-        int available_lines = ctx->params.page_height - header_lines - footer_lines;
+// WIDTHS=AUTO: cada columna toma el ancho de su celda más ancha
+void fit_table_widths(stroff_context_t *ctx, table_t *table) {
+    int natural[MAX_TABLE_COLS];
 
-        if (ctx->current_line + lines_needed > available_lines) {
-            new_page(ctx);
+    for (int col = 0; col < table->cols; col++) {
+        natural[col] = table->header_widths[col];
+        const int *widths = table->columns[col].widths;
+        for (int row = 0; row < table->row_count; row++) {
+            if (widths[row] > natural[col]) natural[col] = widths[row];
         }
     }
+
+    fit_table_columns(ctx, table, natural);
 }
 
-void output_line(stroff_context_t *ctx, const char *text) {
+// Anchos a partir del ancho natural de cada columna. Si la tabla no cabe en el ancho
+// de contenido, se recortan primero las columnas más anchas
+void fit_table_columns(stroff_context_t *ctx, table_t *table, const int *natural_widths) {
+    int natural[MAX_TABLE_COLS];
+    int total = 0;
+    int widest = 0;
+
+    for (int col = 0; col < table->cols; col++) {
+        natural[col] = natural_widths[col] > 0 ? natural_widths[col] : 1;
+        total += natural[col];
+        if (natural[col] > widest) widest = natural[col];
+    }
+
+    int content_width = ctx->geometry.content_width;
+    int available = content_width - (table->cols - 1) * 2;
+
+    if (total <= available || available < table->cols) {
+        int cap = total <= available ? widest : 1;
+        for (int col = 0; col < table->cols; col++) {
+            table->widths[col] = natural[col] < cap ? natural[col] : cap;
+        }
+        return;
+    }
+
+    // Tope común más alto con el que la tabla cabe; el sobrante va a las columnas recortadas
+    int low = 1;
+    int high = widest;
+    while (low < high) {
+        int cap = (low + high + 1) / 2;
+        int sum = 0;
+        for (int col = 0; col < table->cols; col++) {
+            sum += natural[col] < cap ? natural[col] : cap;
+        }
+        if (sum <= available) low = cap;
+        else high = cap - 1;
+    }
+
+    int used = 0;
+    for (int col = 0; col < table->cols; col++) {
+        table->widths[col] = natural[col] < low ? natural[col] : low;
+        used += table->widths[col];
+    }
+    for (int col = 0; col < table->cols && used < available; col++) {
+        if (natural[col] > table->widths[col]) {
+            table->widths[col]++;
+            used++;
+        }
+    }
+}
+
+static void output_table_rule(stroff_context_t *ctx, const table_t *table) {
+    output_spaces(ctx, ctx->params.left_margin);
+
+    int total_width = 0;
+    for (int col = 0; col < table->cols; col++) {
+        total_width += table->widths[col];
+    }
+    if (table->cols > 1) {
+        total_width += (table->cols - 1) * 2;
+    }
+    for (int i = 0; i < total_width; i++) {
+        output_raw(ctx, "-", 1);
+    }
+    output_newline(ctx);
+}
+
+// Cabecera más su TLINE: lo que se repite al principio de cada página de la tabla
+static int table_header_height(const table_t *table) {
+    if (!table_has_headers(table)) return 0;
+    return table_row_height(table, -1) + table_has_rule_after(table, -1);
+}
+
+static void output_table_header(stroff_context_t *ctx, const table_t *table) {
+    if (!table_has_headers(table)) return;
+
+    text_table_cells(ctx, table, -1);
+    if (table_has_rule_after(table, -1)) {
+        output_table_rule(ctx, table);
+    }
+}
+
+static void text_table_begin(stroff_context_t *ctx, render_target_t *target, const table_t *table) {
+    text_blank_line(ctx, target);
+
+    // La cabecera no se queda sola al pie de la página: va con su TLINE y la primera fila
+    if (table_has_headers(table)) {
+        check_page_break(ctx, table_header_height(table) + 1);
+        text_table_cells(ctx, table, -1);
+    }
+}
+
+// Las filas no se parten entre páginas; en cada página nueva se repite la cabecera
+static void text_table_row(stroff_context_t *ctx, render_target_t *target, const table_t *table, int row) {
+    (void)target;
+    int height = table_row_height(table, row);
+
+    if (check_page_break(ctx, height)) {
+        output_table_header(ctx, table);
+    }
+    text_table_cells(ctx, table, row);
+}
+
+// Una TLINE que cae al pie de la página no hace falta: se omite
+static void text_table_rule(stroff_context_t *ctx, render_target_t *target, const table_t *table) {
+    (void)target;
+    if (ctx->params.page_height > 0 && ctx->current_line >= ctx->geometry.body_lines) return;
+    output_table_rule(ctx, table);
+}
+
+static void text_table_end(stroff_context_t *ctx, render_target_t *target, const table_t *table) {
+    (void)table;
+    text_blank_line(ctx, target);
+}
+
+// Línea de código con los tabuladores expandidos hasta el siguiente múltiplo de
+// .TABSIZE, contando columnas desde el margen. Los tramos sin tabulador se copian
+// enteros; con .TABSIZE 0 los tabuladores se dejan como están
+static void output_code_text(stroff_context_t *ctx, const char *text) {
+    int tab_size = ctx->params.tab_size;
+    const char *tab = tab_size > 0 ? strchr(text, '\t') : NULL;
+    if (!tab) {
+        output_string(ctx, text);
+        return;
+    }
+
+    int column = 0;
+    while (tab) {
+        output_raw(ctx, text, (int)(tab - text));
+        // Columnas visibles del tramo: bytes que no son continuación UTF-8
+        for (const char *p = text; p < tab; p++) {
+            if (((unsigned char)*p & 0xC0) != 0x80) column++;
+        }
+        int spaces = tab_size - column % tab_size;
+        output_spaces(ctx, spaces);
+        column += spaces;
+
+        text = tab + 1;
+        tab = strchr(text, '\t');
+    }
+    output_string(ctx, text);
+}
+
+static void text_code_line(stroff_context_t *ctx, render_target_t *target, const char *text) {
+    (void)target;
     check_page_break(ctx, 1);
-    fprintf(ctx->output, "%s\n", text);
-    ctx->current_line++;
-}
-
-void substitute_variables(stroff_context_t *ctx, char *text) {
-    char result[MAX_TITLE_LENGTH];
-    char *pos;
-
-    // Usar un buffer temporal para evitar corrupción de memoria
-    strcpy(result, text);
-
-    pos = strstr(result, "{TITLE}");
-    if (pos) {
-        char before[MAX_TITLE_LENGTH];
-        strncpy(before, result, pos - result);
-        before[pos - result] = '\0';
-        snprintf(text, MAX_TITLE_LENGTH, "%s%s%s", before, ctx->params.title, pos + 7);
-        strcpy(result, text);
-    }
-
-    pos = strstr(result, "{CHAPTITLE}");
-    if (pos) {
-        char before[MAX_TITLE_LENGTH];
-        strncpy(before, result, pos - result);
-        before[pos - result] = '\0';
-        snprintf(text, MAX_TITLE_LENGTH, "%s%s%s", before, ctx->current_chapter, pos + 11);
-        strcpy(result, text);
-    }
-
-    pos = strstr(result, "{SUBCHAP}");
-    if (pos) {
-        char before[MAX_TITLE_LENGTH];
-        strncpy(before, result, pos - result);
-        before[pos - result] = '\0';
-        snprintf(text, MAX_TITLE_LENGTH, "%s%s%s", before, ctx->current_subchap, pos + 9);
-        strcpy(result, text);
-    }
-
-    pos = strstr(result, "{SUBSUBCHAP}");
-    if (pos) {
-        char before[MAX_TITLE_LENGTH];
-        strncpy(before, result, pos - result);
-        before[pos - result] = '\0';
-        snprintf(text, MAX_TITLE_LENGTH, "%s%s%s", before, ctx->current_subsubchap, pos + 12);
-        strcpy(result, text);
-    }
-
-    pos = strstr(result, "{PAGE}");
-    if (pos) {
-        char before[MAX_TITLE_LENGTH];
-        strncpy(before, result, pos - result);
-        before[pos - result] = '\0';
-        snprintf(text, MAX_TITLE_LENGTH, "%s%d%s", before, ctx->current_page, pos + 6);
-        strcpy(result, text);
-    }
-
-    pos = strstr(result, "{PAGES}");
-    if (pos) {
-        char before[MAX_TITLE_LENGTH];
-        strncpy(before, result, pos - result);
-        before[pos - result] = '\0';
-        snprintf(text, MAX_TITLE_LENGTH, "%s%d%s", before, ctx->total_pages, pos + 7);
-        strcpy(result, text);
-    }
-}
\ No newline at end of file
+    if (ctx->layout_mode == LAYOUT_FULL) {
+        output_spaces(ctx, ctx->params.left_margin);
+        output_code_text(ctx, text);
+    }
+    output_newline(ctx);
+}
+
+static void text_toc(stroff_context_t *ctx, render_target_t *target) {
+    (void)target;
+    output_toc(ctx);
+}
+
+static void text_tot(stroff_context_t *ctx, render_target_t *target) {
+    (void)target;
+    output_tot(ctx);
+}
+
+static void text_index(stroff_context_t *ctx, render_target_t *target) {
+    (void)target;
+    output_index(ctx);
+}
+
+static void text_page_break(stroff_context_t *ctx, render_target_t *target) {
+    (void)target;
+    new_page(ctx);
+}
+
+const renderer_t text_renderer = {
+    .name = "text",
+    .begin_document = text_begin_document,
+    .end_document = text_end_document,
+    .heading = text_heading,
+    .paragraph = text_paragraph,
+    .text = text_text,
+    .line_break = text_line_break,
+    .list_begin = text_list_begin,
+    .list_item = text_list_item,
+    .list_end = text_blank_line,
+    .table_begin = text_table_begin,
+    .table_row = text_table_row,
+    .table_rule = text_table_rule,
+    .table_end = text_table_end,
+    .code_begin = text_blank_line,
+    .code_line = text_code_line,
+    .code_end = text_blank_line,
+    .toc = text_toc,
+    .tot = text_tot,
+    .index = text_index,
+    .page_break = text_page_break
+};
+
+static const struct {
+    const char *name;
+    segment_type_t type;
+} template_variables[] = {
+    {"TITLE", SEG_TITLE},
+    {"CHAPTITLE", SEG_CHAPTITLE},
+    {"SUBCHAP", SEG_SUBCHAP},
+    {"SUBSUBCHAP", SEG_SUBSUBCHAP},
+    {"PAGE", SEG_PAGE},
+    {"PAGES", SEG_PAGES}
+};
+
+static segment_type_t lookup_template_variable(const char *name, int len) {
+    for (size_t i = 0; i < sizeof(template_variables) / sizeof(template_variables[0]); i++) {
+        if ((int)strlen(template_variables[i].name) == len &&
+            strncmp(template_variables[i].name, name, len) == 0) {
+            return template_variables[i].type;
+        }
+    }
+    return SEG_LITERAL;
+}
+
+static void add_literal_segment(text_template_t *tpl, int offset, int length) {
+    if (length <= 0 || tpl->segment_count >= MAX_TEMPLATE_SEGMENTS) return;
+
+    tpl->segments[tpl->segment_count].type = SEG_LITERAL;
+    tpl->segments[tpl->segment_count].offset = offset;
+    tpl->segments[tpl->segment_count].length = length;
+    tpl->segment_count++;
+}
+
+void compile_template(text_template_t *tpl, const char *text) {
+    strncpy(tpl->source, text, MAX_TITLE_LENGTH - 1);
+    tpl->source[MAX_TITLE_LENGTH - 1] = '\0';
+    tpl->segment_count = 0;
+
+    const char *src = tpl->source;
+    int literal_start = 0;
+    int i = 0;
+
+    while (src[i]) {
+        if (src[i] == '{') {
+            const char *close = strchr(src + i + 1, '}');
+            if (close) {
+                int name_len = (int)(close - (src + i + 1));
+                segment_type_t type = lookup_template_variable(src + i + 1, name_len);
+                if (type != SEG_LITERAL && tpl->segment_count < MAX_TEMPLATE_SEGMENTS - 1) {
+                    add_literal_segment(tpl, literal_start, i - literal_start);
+                    tpl->segments[tpl->segment_count].type = type;
+                    tpl->segments[tpl->segment_count].offset = 0;
+                    tpl->segments[tpl->segment_count].length = 0;
+                    tpl->segment_count++;
+                    i += name_len + 2;
+                    literal_start = i;
+                    continue;
+                }
+            }
+        }
+        i++;
+    }
+
+    add_literal_segment(tpl, literal_start, i - literal_start);
+}
+
+static int append_bytes(char *out, int pos, int out_size, const char *text, int len) {
+    if (pos + len > out_size - 1) {
+        len = out_size - 1 - pos;
+    }
+    if (len > 0) {
+        memcpy(out + pos, text, len);
+        pos += len;
+    }
+    return pos;
+}
+
+int render_template(stroff_context_t *ctx, const text_template_t *tpl, char *out, int out_size) {
+    int pos = 0;
+    char number[16];
+
+    for (int i = 0; i < tpl->segment_count; i++) {
+        const template_segment_t *seg = &tpl->segments[i];
+        const char *value = NULL;
+
+        switch (seg->type) {
+            case SEG_LITERAL:
+                pos = append_bytes(out, pos, out_size, tpl->source + seg->offset, seg->length);
+                continue;
+            case SEG_TITLE:
+                value = ctx->params.title;
+                break;
+            case SEG_CHAPTITLE:
+                value = ctx->current_chapter;
+                break;
+            case SEG_SUBCHAP:
+                value = ctx->current_subchap;
+                break;
+            case SEG_SUBSUBCHAP:
+                value = ctx->current_subsubchap;
+                break;
+            case SEG_PAGE:
+                snprintf(number, sizeof(number), "%d", ctx->current_page);
+                value = number;
+                break;
+            case SEG_PAGES:
+                snprintf(number, sizeof(number), "%d", ctx->total_pages);
+                value = number;
+                break;
+        }
+
+        pos = append_bytes(out, pos, out_size, value, strlen(value));
+    }
+
+    out[pos] = '\0';
+    return pos;
+}
@@ -0,0 +1,269 @@
+#include "stroff.h"
+
+// Backend HTML: documento autocontenido; los encabezados llevan un id al que
+// enlaza la tabla de contenidos. Sin paginación: PAGEBREAK solo afecta a la impresión
+
+static void html_escape(FILE *out, const char *text) {
+    for (const char *p = text; *p; p++) {
+        switch (*p) {
+            case '&': fputs("&amp;", out); break;
+            case '<': fputs("&lt;", out); break;
+            case '>': fputs("&gt;", out); break;
+            case '"': fputs("&quot;", out); break;
+            default: fputc(*p, out); break;
+        }
+    }
+}
+
+static const char *html_align_style(align_t align) {
+    switch (align) {
+        case ALIGN_CENTER: return " style=\"text-align: center\"";
+        case ALIGN_RIGHT: return " style=\"text-align: right\"";
+        case ALIGN_FULL: return " style=\"text-align: justify\"";
+        default: return "";
+    }
+}
+
+static void html_close_paragraph(render_target_t *target) {
+    if (target->paragraph_open) {
+        fputs("</p>\n", target->output);
+        target->paragraph_open = 0;
+    }
+}
+
+static void html_begin_document(stroff_context_t *ctx, render_target_t *target) {
+    FILE *out = target->output;
+
+    fputs("<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>", out);
+    html_escape(out, ctx->params.title);
+    fputs("</title>\n</head>\n<body>\n", out);
+
+    if (strlen(ctx->params.title) > 0) {
+        fputs("<h1 class=\"title\">", out);
+        html_escape(out, ctx->params.title);
+        fputs("</h1>\n", out);
+    }
+    if (strlen(ctx->params.author) > 0) {
+        fputs("<p class=\"author\">", out);
+        html_escape(out, ctx->params.author);
+        fputs("</p>\n", out);
+    }
+    if (strlen(ctx->params.date) > 0) {
+        fputs("<p class=\"date\">", out);
+        html_escape(out, ctx->params.date);
+        fputs("</p>\n", out);
+    }
+}
+
+static void html_end_document(stroff_context_t *ctx, render_target_t *target) {
+    (void)ctx;
+    html_close_paragraph(target);
+    fputs("</body>\n</html>\n", target->output);
+}
+
+static void html_heading(stroff_context_t *ctx, render_target_t *target, const char *title, int level, int index) {
+    (void)ctx;
+    html_close_paragraph(target);
+
+    // h1 queda para el título del documento
+    fprintf(target->output, "<h%d id=\"sec-%d\">", level + 1, index);
+    html_escape(target->output, title);
+    fprintf(target->output, "</h%d>\n", level + 1);
+}
+
+static void html_paragraph(stroff_context_t *ctx, render_target_t *target, align_t align) {
+    (void)ctx;
+    html_close_paragraph(target);
+    fprintf(target->output, "<p%s>\n", html_align_style(align));
+    target->paragraph_open = 1;
+}
+
+static void html_text(stroff_context_t *ctx, render_target_t *target, const char *text, align_t align) {
+    // Texto sin .P previo: párrafo implícito
+    if (!target->paragraph_open) {
+        html_paragraph(ctx, target, align);
+    }
+    html_escape(target->output, text);
+    fputc('\n', target->output);
+}
+
+static void html_line_break(stroff_context_t *ctx, render_target_t *target) {
+    (void)ctx;
+    if (target->paragraph_open) {
+        fputs("<br>\n", target->output);
+    }
+}
+
+static void html_list_begin(stroff_context_t *ctx, render_target_t *target, list_type_t type) {
+    (void)ctx;
+    html_close_paragraph(target);
+
+    if (type == LIST_NUMBER) {
+        fputs("<ol>\n", target->output);
+    } else if (type == LIST_RNUMBER) {
+        fputs("<ol type=\"I\">\n", target->output);
+    } else {
+        fputs("<ul>\n", target->output);
+    }
+}
+
+static void html_list_item(stroff_context_t *ctx, render_target_t *target, const char *prefix, const char *text) {
+    (void)ctx;
+    (void)prefix;
+    fputs("<li>", target->output);
+    html_escape(target->output, text);
+    fputs("</li>\n", target->output);
+}
+
+static void html_list_end(stroff_context_t *ctx, render_target_t *target) {
+    list_type_t type = ctx->current_list.type;
+    fputs(type == LIST_NUMBER || type == LIST_RNUMBER ? "</ol>\n" : "</ul>\n", target->output);
+}
+
+static void html_table_cells(render_target_t *target, const table_t *table, const char *tag, int row) {
+    fputs("<tr>", target->output);
+    for (int col = 0; col < table->cols; col++) {
+        fprintf(target->output, "<%s%s>", tag, html_align_style(table->aligns[col]));
+        html_escape(target->output, table_cell(table, row, col));
+        fprintf(target->output, "</%s>", tag);
+    }
+    fputs("</tr>\n", target->output);
+}
+
+static void html_table_begin(stroff_context_t *ctx, render_target_t *target, const table_t *table) {
+    (void)ctx;
+    html_close_paragraph(target);
+    fputs("<table>\n", target->output);
+
+    if (table->name[0]) {
+        fputs("<caption>", target->output);
+        html_escape(target->output, table->name);
+        fputs("</caption>\n", target->output);
+    }
+
+    if (table_has_headers(table)) {
+        fputs("<thead>\n", target->output);
+        html_table_cells(target, table, "th", -1);
+        fputs("</thead>\n", target->output);
+    }
+    fputs("<tbody>\n", target->output);
+}
+
+static void html_table_row(stroff_context_t *ctx, render_target_t *target, const table_t *table, int row) {
+    (void)ctx;
+    html_table_cells(target, table, "td", row);
+}
+
+static void html_table_end(stroff_context_t *ctx, render_target_t *target, const table_t *table) {
+    (void)ctx;
+    (void)table;
+    fputs("</tbody>\n</table>\n", target->output);
+}
+
+static void html_code_begin(stroff_context_t *ctx, render_target_t *target) {
+    (void)ctx;
+    html_close_paragraph(target);
+    fputs("<pre><code>", target->output);
+    target->code_open = 1;
+}
+
+static void html_code_line(stroff_context_t *ctx, render_target_t *target, const char *text) {
+    (void)ctx;
+    html_escape(target->output, text);
+    fputc('\n', target->output);
+}
+
+static void html_code_end(stroff_context_t *ctx, render_target_t *target) {
+    (void)ctx;
+    // Un .ECODE sin bloque abierto no cierra nada
+    if (!target->code_open) return;
+    fputs("</code></pre>\n", target->output);
+    target->code_open = 0;
+}
+
+static void html_toc(stroff_context_t *ctx, render_target_t *target) {
+    html_close_paragraph(target);
+    fputs("<nav class=\"toc\">\n<h2>TABLA DE CONTENIDOS</h2>\n<ul>\n", target->output);
+
+    for (int i = 0; i < ctx->chapter_count; i++) {
+        fprintf(target->output, "<li class=\"toc-%d\"><a href=\"#sec-%d\">", ctx->chapters[i].level, i);
+        html_escape(target->output, ctx->chapters[i].title);
+        fputs("</a></li>\n", target->output);
+    }
+
+    fputs("</ul>\n</nav>\n", target->output);
+}
+
+static void html_tot(stroff_context_t *ctx, render_target_t *target) {
+    html_close_paragraph(target);
+    fputs("<nav class=\"tot\">\n<h2>INDICE DE TABLAS</h2>\n<ul>\n", target->output);
+
+    for (int i = 0; i < ctx->table_ref_count; i++) {
+        fputs("<li>", target->output);
+        html_escape(target->output, ctx->table_refs[i].name);
+        fputs("</li>\n", target->output);
+    }
+
+    fputs("</ul>\n</nav>\n", target->output);
+}
+
+// Índice alfabético: un <dl> por inicial. Las páginas son las de la salida de texto
+static void html_index(stroff_context_t *ctx, render_target_t *target) {
+    html_close_paragraph(target);
+    fputs("<nav class=\"index\">\n<h2>INDICE ALFABETICO</h2>\n", target->output);
+
+    int count;
+    index_order_t *order = sort_index_terms(ctx, &count);
+    char *pages = NULL;
+    int capacity = 0;
+    char group[4] = "";
+    char letter[2];
+    for (int i = 0; i < count; i++) {
+        const index_term_t *entry = &ctx->index_terms[order[i].term];
+        const char *heading = index_group_heading(order[i].initial, letter);
+        if (i == 0 || strcmp(heading, group) != 0) {
+            if (i > 0) fputs("</dl>\n", target->output);
+            fprintf(target->output, "<h3>%s</h3>\n<dl>\n", heading);
+            strcpy(group, heading);
+        }
+        format_index_pages(ctx, entry, &pages, &capacity);
+        fputs("<dt>", target->output);
+        html_escape(target->output, entry->term);
+        fprintf(target->output, "</dt><dd>%s</dd>\n", pages);
+    }
+    if (count > 0) fputs("</dl>\n", target->output);
+    free(pages);
+    free(order);
+
+    fputs("</nav>\n", target->output);
+}
+
+static void html_page_break(stroff_context_t *ctx, render_target_t *target) {
+    (void)ctx;
+    html_close_paragraph(target);
+    fputs("<div style=\"page-break-after: always\"></div>\n", target->output);
+}
+
+const renderer_t html_renderer = {
+    .name = "html",
+    .begin_document = html_begin_document,
+    .end_document = html_end_document,
+    .heading = html_heading,
+    .paragraph = html_paragraph,
+    .text = html_text,
+    .line_break = html_line_break,
+    .list_begin = html_list_begin,
+    .list_item = html_list_item,
+    .list_end = html_list_end,
+    .table_begin = html_table_begin,
+    .table_row = html_table_row,
+    .table_rule = NULL,
+    .table_end = html_table_end,
+    .code_begin = html_code_begin,
+    .code_line = html_code_line,
+    .code_end = html_code_end,
+    .toc = html_toc,
+    .tot = html_tot,
+    .index = html_index,
+    .page_break = html_page_break
+};
@@ -0,0 +1,165 @@
+#include "stroff.h"
+
+// División silábica con patrones de Liang. Los patrones llegan ya compilados en
+// un trie (tools/hyphc); buscar una palabra no reserva memoria y recorre, desde
+// cada posición, solo tantos nodos como mida el patrón más largo. Los cortes de
+// cada palabra se guardan en una caché de acceso directo
+
+int find_hyphen_language(const char *name) {
+    for (int i = 0; i < hyph_trie_count; i++) {
+        if (strcmp(hyph_tries[i].language, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int trie_child(const hyph_trie_t *trie, int node, unsigned char c) {
+    int low = trie->first_edge[node];
+    int high = trie->first_edge[node + 1] - 1;
+
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (trie->edge_chars[mid] == c) return trie->edge_targets[mid];
+        if (trie->edge_chars[mid] < c) low = mid + 1;
+        else high = mid - 1;
+    }
+    return -1;
+}
+
+// Letras que admiten división: ASCII y UTF-8 salvo el bloque C2 (signos como ¿ ¡ « »)
+static int is_word_byte(const unsigned char *text, int i) {
+    if (text[i] < 0x80) return isalpha(text[i]);
+    if (text[i] == 0xC2) return 0;
+    if ((text[i] & 0xC0) == 0x80) return i > 0 && text[i - 1] != 0xC2;
+    return 1;
+}
+
+// Minúsculas ASCII y Latin-1 (À..Þ -> à..þ) sin cambiar la longitud en bytes
+static void lowercase_word(const char *word, int len, unsigned char *out) {
+    for (int i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)word[i];
+        if (c < 0x80) {
+            out[i] = (unsigned char)tolower(c);
+        } else if (i > 0 && out[i - 1] == 0xC3 && c >= 0x80 && c <= 0x9E && c != 0x97) {
+            out[i] = c + 0x20;
+        } else {
+            out[i] = c;
+        }
+    }
+}
+
+// Bit p: se puede cortar antes del byte p de la palabra (ya en minúsculas)
+static unsigned long long compute_points(const hyph_trie_t *trie, const unsigned char *word, int len) {
+    unsigned char text[HYPHEN_MAX_WORD + 2];
+    unsigned char points[HYPHEN_MAX_WORD + 3];
+    int n = len + 2;
+
+    text[0] = '.';
+    memcpy(text + 1, word, (size_t)len);
+    text[len + 1] = '.';
+    memset(points, 0, (size_t)n + 1);
+
+    for (int i = 0; i < n; i++) {
+        int node = 0;
+        for (int j = i; j < n; j++) {
+            node = trie_child(trie, node, text[j]);
+            if (node < 0) break;
+
+            int offset = trie->node_values[node];
+            if (offset) {
+                int count = trie->values[offset];
+                const unsigned char *digits = trie->values + offset + 1;
+                for (int k = 0; k < count; k++) {
+                    if (digits[k] > points[i + k]) points[i + k] = digits[k];
+                }
+            }
+        }
+    }
+
+    int total_chars = 0;
+    for (int p = 0; p < len; p++) {
+        if ((word[p] & 0xC0) != 0x80) total_chars++;
+    }
+
+    unsigned long long result = 0;
+    int chars_before = 0;
+    for (int p = 0; p < len; p++) {
+        if ((word[p] & 0xC0) == 0x80) continue;
+        if (p > 0 && (points[p + 1] & 1) &&
+            chars_before >= trie->left_min && total_chars - chars_before >= trie->right_min) {
+            result |= 1ULL << p;
+        }
+        chars_before++;
+    }
+    return result;
+}
+
+static unsigned long long word_points(stroff_context_t *ctx, const char *word, int len) {
+    const hyph_trie_t *trie = &hyph_tries[ctx->params.hyphenate];
+    unsigned char lower[HYPHEN_MAX_WORD];
+    lowercase_word(word, len, lower);
+
+    if (len >= HYPHEN_CACHE_WORD) {
+        return compute_points(trie, lower, len);
+    }
+
+    if (!ctx->hyphen_cache) {
+        ctx->hyphen_cache = calloc(HYPHEN_CACHE_SIZE, sizeof(hyphen_cache_entry_t));
+        if (!ctx->hyphen_cache) {
+            return compute_points(trie, lower, len);
+        }
+    }
+
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ lower[i]) * 16777619u;
+    }
+    hyphen_cache_entry_t *entry = &ctx->hyphen_cache[(hash ^ (unsigned int)ctx->params.hyphenate) & (HYPHEN_CACHE_SIZE - 1)];
+
+    if (entry->language == ctx->params.hyphenate && memcmp(entry->word, lower, (size_t)len) == 0 &&
+        entry->word[len] == '\0') {
+        return entry->points;
+    }
+
+    entry->points = compute_points(trie, lower, len);
+    entry->language = ctx->params.hyphenate;
+    memcpy(entry->word, lower, (size_t)len);
+    entry->word[len] = '\0';
+    return entry->points;
+}
+
+// Bytes de word que caben en max_length junto con el guion, cortando por el punto de
+// división más a la derecha posible; 0 si no hay ninguno. Los signos al principio y
+// al final de la palabra quedan fuera de la división
+int hyphen_split_point(stroff_context_t *ctx, const char *word, int max_length) {
+    if (ctx->params.hyphenate < 0) return 0;
+
+    const unsigned char *text = (const unsigned char *)word;
+    int len = (int)strlen(word);
+    int start = 0;
+    int end = len;
+
+    while (start < end && !is_word_byte(text, start)) start++;
+    while (end > start && !is_word_byte(text, end - 1)) end--;
+
+    int core_len = end - start;
+    if (core_len < 2 || core_len > HYPHEN_MAX_WORD) return 0;
+    for (int i = start; i < end; i++) {
+        if (!is_word_byte(text, i)) return 0;
+    }
+
+    unsigned long long points = word_points(ctx, word + start, core_len);
+    for (int p = core_len - 1; p > 0; p--) {
+        if (((points >> p) & 1) && start + p + 1 <= max_length) {
+            return start + p;
+        }
+    }
+    return 0;
+}
+
+void free_hyphen_cache(stroff_context_t *ctx) {
+    free(ctx->hyphen_cache);
+    ctx->hyphen_cache = NULL;
+}
@@ -0,0 +1,380 @@
+#include "stroff.h"
+#include <sys/stat.h>
+
+// Resolución de .INCLUDE/.TABLEFILE y pila de inclusión. Una ruta relativa se
+// busca junto al archivo que la incluye y después en cada directorio -I; el
+// resultado (también el de no encontrarla) se guarda en una caché para no repetir
+// las mismas pruebas en cada inclusión y en cada pasada. Los ciclos se detectan
+// por dispositivo+inodo antes de abrir el archivo
+
+#define INCLUDE_CACHE_INITIAL 64
+
+static int is_absolute_path(const char *path) {
+    if (!path || !path[0]) {
+        return 0;
+    }
+
+#ifdef _WIN32
+    if (path[0] == '\\' || path[0] == '/') {
+        return 1;
+    }
+    if (strlen(path) > 1 && path[1] == ':') {
+        return 1;
+    }
+    return 0;
+#else
+    return path[0] == '/';
+#endif
+}
+
+static void join_paths(const char *base, const char *relative, char *out) {
+    if (!base || !base[0]) {
+        strncpy(out, relative, MAX_PATH_LENGTH - 1);
+        out[MAX_PATH_LENGTH - 1] = '\0';
+        return;
+    }
+
+    size_t base_len = strlen(base);
+    int has_separator = base_len > 0 && (base[base_len - 1] == '/' || base[base_len - 1] == '\\');
+    if (has_separator) {
+        snprintf(out, MAX_PATH_LENGTH, "%s%s", base, relative);
+    } else {
+        snprintf(out, MAX_PATH_LENGTH, "%s/%s", base, relative);
+    }
+}
+
+static void get_directory(const char *path, char *dir_out) {
+    if (!path || !path[0]) {
+        dir_out[0] = '\0';
+        return;
+    }
+
+    const char *last_sep = NULL;
+    for (const char *p = path; *p; p++) {
+        if (*p == '/' || *p == '\\') {
+            last_sep = p;
+        }
+    }
+
+    if (!last_sep) {
+        dir_out[0] = '\0';
+        return;
+    }
+
+    size_t dir_len = (size_t)(last_sep - path);
+
+    if (dir_len == 0) {
+        dir_out[0] = *last_sep;
+        dir_out[1] = '\0';
+        return;
+    }
+
+    if (dir_len >= MAX_PATH_LENGTH) {
+        dir_len = MAX_PATH_LENGTH - 1;
+    }
+
+    strncpy(dir_out, path, dir_len);
+    dir_out[dir_len] = '\0';
+}
+
+static int is_regular_file(const char *path, struct stat *info) {
+    return stat(path, info) == 0 && S_ISREG(info->st_mode);
+}
+
+// Junto al archivo que incluye y luego en cada -I, en orden. Si no aparece en
+// ninguno se devuelve la primera ruta, la que dará el mensaje de error
+static void search_include(stroff_context_t *ctx, const char *base, const char *filename, char *resolved) {
+    struct stat info;
+    join_paths(base, filename, resolved);
+    if (ctx->include_dir_count == 0 || is_regular_file(resolved, &info)) return;
+
+    char candidate[MAX_PATH_LENGTH];
+    for (int i = 0; i < ctx->include_dir_count; i++) {
+        join_paths(ctx->include_dirs[i], filename, candidate);
+        if (is_regular_file(candidate, &info)) {
+            memcpy(resolved, candidate, MAX_PATH_LENGTH);
+            return;
+        }
+    }
+}
+
+// FNV-1a de "directorio base\nnombre"
+static unsigned int include_key_hash(const char *base, const char *filename) {
+    unsigned int hash = 2166136261u;
+    for (const char *p = base; *p; p++) hash = (hash ^ (unsigned char)*p) * 16777619u;
+    hash = (hash ^ '\n') * 16777619u;
+    for (const char *p = filename; *p; p++) hash = (hash ^ (unsigned char)*p) * 16777619u;
+    return hash;
+}
+
+static int include_key_matches(const include_cache_entry_t *entry, const char *base, const char *filename) {
+    size_t base_len = strlen(base);
+    return strncmp(entry->key, base, base_len) == 0 && entry->key[base_len] == '\n' &&
+           strcmp(entry->key + base_len + 1, filename) == 0;
+}
+
+static int grow_include_cache(stroff_context_t *ctx) {
+    int size = ctx->include_cache_size ? ctx->include_cache_size * 2 : INCLUDE_CACHE_INITIAL;
+    include_cache_entry_t *table = calloc((size_t)size, sizeof(include_cache_entry_t));
+    if (!table) return 0;
+
+    for (int i = 0; i < ctx->include_cache_size; i++) {
+        include_cache_entry_t *entry = &ctx->include_cache[i];
+        if (!entry->key) continue;
+        int slot = (int)(entry->hash & (unsigned int)(size - 1));
+        while (table[slot].key) slot = (slot + 1) & (size - 1);
+        table[slot] = *entry;
+    }
+    free(ctx->include_cache);
+    ctx->include_cache = table;
+    ctx->include_cache_size = size;
+    return 1;
+}
+
+static void cache_include(stroff_context_t *ctx, unsigned int hash, const char *base,
+                          const char *filename, const char *resolved) {
+    if ((ctx->include_cache_count + 1) * 2 > ctx->include_cache_size && !grow_include_cache(ctx)) {
+        return;
+    }
+
+    size_t base_len = strlen(base);
+    size_t name_len = strlen(filename);
+    size_t resolved_len = strlen(resolved);
+    char *key = malloc(base_len + name_len + resolved_len + 3);
+    if (!key) return;
+    memcpy(key, base, base_len);
+    key[base_len] = '\n';
+    memcpy(key + base_len + 1, filename, name_len + 1);
+    memcpy(key + base_len + name_len + 2, resolved, resolved_len + 1);
+
+    int mask = ctx->include_cache_size - 1;
+    int slot = (int)(hash & (unsigned int)mask);
+    while (ctx->include_cache[slot].key) slot = (slot + 1) & mask;
+    ctx->include_cache[slot].hash = hash;
+    ctx->include_cache[slot].key = key;
+    ctx->include_cache[slot].resolved = key + base_len + name_len + 2;
+    ctx->include_cache_count++;
+}
+
+void resolve_include_path(stroff_context_t *ctx, const char *filename, char *resolved) {
+    // El documento principal y las rutas absolutas se usan tal cual
+    if (is_absolute_path(filename) || ctx->include_depth == 0) {
+        strncpy(resolved, filename, MAX_PATH_LENGTH - 1);
+        resolved[MAX_PATH_LENGTH - 1] = '\0';
+        return;
+    }
+
+    const char *base = ctx->include_stack[ctx->include_depth - 1];
+    unsigned int hash = include_key_hash(base, filename);
+    if (ctx->include_cache_size > 0) {
+        int mask = ctx->include_cache_size - 1;
+        for (int slot = (int)(hash & (unsigned int)mask); ctx->include_cache[slot].key; slot = (slot + 1) & mask) {
+            const include_cache_entry_t *entry = &ctx->include_cache[slot];
+            if (entry->hash == hash && include_key_matches(entry, base, filename)) {
+                memcpy(resolved, entry->resolved, strlen(entry->resolved) + 1);
+                return;
+            }
+        }
+    }
+
+    search_include(ctx, base, filename, resolved);
+    cache_include(ctx, hash, base, filename, resolved);
+}
+
+void add_include_dir(stroff_context_t *ctx, const char *dir) {
+    char **grown = realloc(ctx->include_dirs, sizeof(char *) * (size_t)(ctx->include_dir_count + 1));
+    size_t len = strlen(dir) + 1;
+    char *copy = malloc(len);
+    if (!grown || !copy) {
+        fprintf(stderr, "Error: Memoria insuficiente para el directorio de inclusión '%s'\n", dir);
+        free(copy);
+        if (grown) ctx->include_dirs = grown;
+        return;
+    }
+    memcpy(copy, dir, len);
+    ctx->include_dirs = grown;
+    ctx->include_dirs[ctx->include_dir_count++] = copy;
+}
+
+// Apila el archivo antes de abrirlo. Devuelve 0, con el error ya avisado, si no
+// existe, si ya está abierto más arriba en la pila (ciclo) o si se supera la profundidad
+int enter_include(stroff_context_t *ctx, const char *resolved_path) {
+    struct stat info;
+    if (stat(resolved_path, &info) != 0) {
+        report_error(ctx, "No se puede abrir el archivo '%s'", resolved_path);
+        return 0;
+    }
+
+    file_id_t id = {(unsigned long long)info.st_dev, (unsigned long long)info.st_ino};
+    for (int i = 0; i < ctx->include_depth; i++) {
+        if (ctx->include_files[i].device == id.device && ctx->include_files[i].inode == id.inode) {
+            // Todas las pasadas leen los mismos archivos: basta con avisar en la primera
+            if (ctx->outline_only) {
+                report_error(ctx, "Inclusión circular: '%s' ya se está procesando", resolved_path);
+            }
+            return 0;
+        }
+    }
+
+    if (ctx->include_depth >= MAX_INCLUDE_DEPTH) {
+        report_error(ctx, "Límite de inclusión excedido (%d niveles)", MAX_INCLUDE_DEPTH);
+        return 0;
+    }
+
+    get_directory(resolved_path, ctx->include_stack[ctx->include_depth]);
+    ctx->include_files[ctx->include_depth] = id;
+    ctx->include_depth++;
+    return 1;
+}
+
+// Archivo que ya se incluyó al compilar el documento (--compile): no se vuelve a
+// abrir, solo se apila su directorio para las rutas relativas de sus comandos
+int enter_compiled_include(stroff_context_t *ctx, const char *resolved_path) {
+    if (ctx->include_depth >= MAX_INCLUDE_DEPTH) {
+        report_error(ctx, "Límite de inclusión excedido (%d niveles)", MAX_INCLUDE_DEPTH);
+        return 0;
+    }
+
+    get_directory(resolved_path, ctx->include_stack[ctx->include_depth]);
+    ctx->include_files[ctx->include_depth].device = 0;
+    ctx->include_files[ctx->include_depth].inode = 0;
+    ctx->include_depth++;
+    return 1;
+}
+
+void leave_include(stroff_context_t *ctx) {
+    ctx->include_depth--;
+    ctx->include_stack[ctx->include_depth][0] = '\0';
+}
+
+void free_include_paths(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->include_cache_size; i++) {
+        free(ctx->include_cache[i].key);
+    }
+    free(ctx->include_cache);
+    ctx->include_cache = NULL;
+    ctx->include_cache_size = 0;
+    ctx->include_cache_count = 0;
+
+    for (int i = 0; i < ctx->include_dir_count; i++) {
+        free(ctx->include_dirs[i]);
+    }
+    free(ctx->include_dirs);
+    ctx->include_dirs = NULL;
+    ctx->include_dir_count = 0;
+}
+
+// --watch: el contenido de cada archivo se guarda en memoria entre reconstrucciones;
+// solo se vuelve a leer del disco el que se invalida por un cambio
+static source_file_t *load_source(stroff_context_t *ctx, const char *path) {
+    source_file_t *source = NULL;
+    for (int i = 0; i < ctx->source_count; i++) {
+        if (strcmp(ctx->sources[i].path, path) == 0) {
+            source = &ctx->sources[i];
+            break;
+        }
+    }
+
+    if (!source) {
+        if (ctx->source_count == ctx->source_capacity) {
+            int capacity = ctx->source_capacity ? ctx->source_capacity * 2 : 16;
+            source_file_t *grown = realloc(ctx->sources, sizeof(source_file_t) * (size_t)capacity);
+            if (!grown) return NULL;
+            ctx->sources = grown;
+            ctx->source_capacity = capacity;
+        }
+        size_t len = strlen(path) + 1;
+        char *copy = malloc(len);
+        if (!copy) return NULL;
+        memcpy(copy, path, len);
+
+        source = &ctx->sources[ctx->source_count++];
+        source->path = copy;
+        source->data = NULL;
+        source->length = 0;
+        source->first_chapter = -1;
+    }
+
+    if (!source->data) {
+        FILE *file = fopen(path, "rb");
+        if (!file) return NULL;
+
+        size_t capacity = 4096;
+        size_t length = 0;
+        char *data = malloc(capacity);
+        size_t read;
+        while (data && (read = fread(data + length, 1, capacity - length, file)) > 0) {
+            length += read;
+            if (length == capacity) {
+                capacity *= 2;
+                char *grown = realloc(data, capacity);
+                if (!grown) free(data);
+                data = grown;
+            }
+        }
+        fclose(file);
+        if (!data) return NULL;
+
+        source->data = data;
+        source->length = length;
+    }
+    return source;
+}
+
+// Procesa un archivo ya apilado desde la caché, cortando las líneas igual que fgets
+int process_cached_source(stroff_context_t *ctx, const char *path) {
+    source_file_t *source = load_source(ctx, path);
+    if (!source) return 0;
+
+    if (source->first_chapter < 0) {
+        source->first_chapter = ctx->chapter_index;
+    }
+
+    // Los includes anidados pueden mover ctx->sources, pero no liberan el contenido
+    const char *data = source->data;
+    size_t length = source->length;
+    size_t pos = 0;
+    char line[MAX_LINE_LENGTH];
+
+    while (!ctx->stop_processing && pos < length) {
+        size_t available = length - pos;
+        size_t max = available < MAX_LINE_LENGTH - 1 ? available : MAX_LINE_LENGTH - 1;
+        const char *newline = memchr(data + pos, '\n', max);
+        size_t n = newline ? (size_t)(newline - (data + pos)) : max;
+
+        memcpy(line, data + pos, n);
+        line[n] = '\0';
+        pos += newline ? n + 1 : n;
+        process_line(ctx, line);
+    }
+    return 1;
+}
+
+// Un archivo cambiado se volverá a leer al procesarlo
+void invalidate_source(stroff_context_t *ctx, const char *path) {
+    for (int i = 0; i < ctx->source_count; i++) {
+        if (strcmp(ctx->sources[i].path, path) == 0) {
+            free(ctx->sources[i].data);
+            ctx->sources[i].data = NULL;
+            ctx->sources[i].length = 0;
+        }
+    }
+}
+
+// Al empezar cada pasada: el primer encabezado de cada archivo se vuelve a anotar
+void reset_source_positions(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->source_count; i++) {
+        ctx->sources[i].first_chapter = -1;
+    }
+}
+
+void free_sources(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->source_count; i++) {
+        free(ctx->sources[i].path);
+        free(ctx->sources[i].data);
+    }
+    free(ctx->sources);
+    ctx->sources = NULL;
+    ctx->source_count = 0;
+    ctx->source_capacity = 0;
+}
@@ -0,0 +1,359 @@
+#include "stroff.h"
+
+// Índice alfabético: .INDEX "término" anota la página actual y .MAKEINDEX lo
+// escribe ordenado, agrupado por inicial y con puntos hasta los números de
+// página. Los términos se internan en un array denso con una tabla hash de
+// índices; las páginas de todos los términos comparten un único pool y cada
+// término enlaza las suyas sin repetir página. Para ordenar, cada término se
+// convierte en una clave de bytes que ordena como un diccionario español
+// (sin tildes, la ñ entre la n y la o) y las claves se ordenan con quicksort
+// de tres vías por bytes, que solo compara cada prefijo común una vez
+
+#define INDEX_SLOTS_INITIAL 256
+#define INDEX_INSERTION_SORT 12     // Particiones menores se ordenan por inserción
+
+static unsigned int term_hash(const char *term) {
+    unsigned int hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)term; *p; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash;
+}
+
+static void *index_realloc(void *data, size_t size) {
+    void *grown = realloc(data, size);
+    if (!grown) {
+        fprintf(stderr, "Error: Memoria insuficiente para el índice alfabético\n");
+        exit(1);
+    }
+    return grown;
+}
+
+static void grow_index_slots(stroff_context_t *ctx) {
+    int size = ctx->index_slot_count ? ctx->index_slot_count * 2 : INDEX_SLOTS_INITIAL;
+    int *slots = index_realloc(NULL, sizeof(int) * (size_t)size);
+    for (int i = 0; i < size; i++) slots[i] = -1;
+
+    for (int i = 0; i < ctx->index_term_count; i++) {
+        int slot = (int)(ctx->index_terms[i].hash & (unsigned int)(size - 1));
+        while (slots[slot] >= 0) slot = (slot + 1) & (size - 1);
+        slots[slot] = i;
+    }
+    free(ctx->index_slots);
+    ctx->index_slots = slots;
+    ctx->index_slot_count = size;
+}
+
+static index_term_t *intern_term(stroff_context_t *ctx, const char *term) {
+    unsigned int hash = term_hash(term);
+    if (ctx->index_slot_count > 0) {
+        int mask = ctx->index_slot_count - 1;
+        for (int slot = (int)(hash & (unsigned int)mask); ctx->index_slots[slot] >= 0; slot = (slot + 1) & mask) {
+            index_term_t *entry = &ctx->index_terms[ctx->index_slots[slot]];
+            if (entry->hash == hash && strcmp(entry->term, term) == 0) return entry;
+        }
+    }
+
+    if ((ctx->index_term_count + 1) * 2 > ctx->index_slot_count) grow_index_slots(ctx);
+    if (ctx->index_term_count == ctx->index_term_capacity) {
+        ctx->index_term_capacity = ctx->index_term_capacity ? ctx->index_term_capacity * 2 : 64;
+        ctx->index_terms = index_realloc(ctx->index_terms, sizeof(index_term_t) * (size_t)ctx->index_term_capacity);
+    }
+
+    size_t len = strlen(term) + 1;
+    index_term_t *entry = &ctx->index_terms[ctx->index_term_count];
+    entry->hash = hash;
+    entry->term = index_realloc(NULL, len);
+    memcpy(entry->term, term, len);
+    entry->first = -1;
+    entry->last = -1;
+
+    int mask = ctx->index_slot_count - 1;
+    int slot = (int)(hash & (unsigned int)mask);
+    while (ctx->index_slots[slot] >= 0) slot = (slot + 1) & mask;
+    ctx->index_slots[slot] = ctx->index_term_count++;
+    return entry;
+}
+
+void add_index_entry(stroff_context_t *ctx, const char *term) {
+    // Sin maquetar no se conoce la página
+    if (ctx->layout_mode == LAYOUT_SKIP || term[0] == '\0') return;
+
+    index_term_t *entry = intern_term(ctx, term);
+    // Las páginas solo crecen: basta comparar con la última. Dentro de un .KEEP la
+    // página aún puede cambiar, así que se anota aparte
+    if (entry->last >= 0 && !ctx->keep.active && ctx->index_pages[entry->last].page == ctx->current_page) {
+        return;
+    }
+
+    if (ctx->index_page_count == ctx->index_page_capacity) {
+        ctx->index_page_capacity = ctx->index_page_capacity ? ctx->index_page_capacity * 2 : 256;
+        ctx->index_pages = index_realloc(ctx->index_pages, sizeof(index_page_t) * (size_t)ctx->index_page_capacity);
+    }
+    int index = ctx->index_page_count++;
+    ctx->index_pages[index].page = ctx->current_page;
+    ctx->index_pages[index].next = -1;
+    if (entry->last >= 0) ctx->index_pages[entry->last].next = index;
+    else entry->first = index;
+    entry->last = index;
+}
+
+// Cada pasada vuelve a anotar las páginas; los términos se conservan internados
+void begin_index_pass(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->index_term_count; i++) {
+        ctx->index_terms[i].first = -1;
+        ctx->index_terms[i].last = -1;
+    }
+    ctx->index_page_count = 0;
+}
+
+// Letra base de U+00C0..U+00FF (segundo byte de la secuencia UTF-8 0xC3 xx);
+// 'N' es la ñ y '\0' deja el carácter como está
+static const char latin1_base[64] =
+    "aaaaaaaceeeeiiiidNooooo\0ouuuuy\0s"
+    "aaaaaaaceeeeiiiidNooooo\0ouuuuy\0y";
+
+// Peso de una letra minúscula: la ñ ocupa el hueco tras la n
+static unsigned char letter_weight(char letter) {
+    if (letter == 'N') return 'o';
+    return (unsigned char)(letter <= 'n' ? letter : letter + 1);
+}
+
+// Clave de orden: pesos primarios (minúsculas sin tildes; espacios y signos
+// ASCII valen lo mismo), un separador 0x01 y el término tal cual para desempatar.
+// Así todas las claves son distintas y basta comparar bytes
+static unsigned char *build_sort_key(const char *term, unsigned char *key) {
+    const unsigned char *p = (const unsigned char *)term;
+    while (*p) {
+        unsigned char c = *p;
+        if (isalpha(c) && c < 0x80) {
+            *key++ = letter_weight((char)tolower(c));
+            p++;
+        } else if (isdigit(c)) {
+            *key++ = c;
+            p++;
+        } else if (c < 0x80) {
+            *key++ = ' ';
+            p++;
+        } else if (c == 0xC3 && p[1] >= 0x80 && p[1] <= 0xBF && latin1_base[p[1] - 0x80]) {
+            *key++ = letter_weight(latin1_base[p[1] - 0x80]);
+            p += 2;
+        } else {
+            *key++ = c;
+            p++;
+        }
+    }
+    *key++ = 0x01;
+    size_t len = strlen(term);
+    memcpy(key, term, len);
+    key += len;
+    *key++ = '\0';
+    return key;
+}
+
+typedef struct {
+    const unsigned char *key;
+    int term;
+} sort_entry_t;
+
+static void swap_entries(sort_entry_t *a, int i, int j) {
+    sort_entry_t tmp = a[i];
+    a[i] = a[j];
+    a[j] = tmp;
+}
+
+// Quicksort de tres vías sobre el byte depth de las claves (Bentley-Sedgewick):
+// los iguales en ese byte avanzan al siguiente sin volver a compararlo
+static void sort_keys(sort_entry_t *a, int n, int depth) {
+    while (n > INDEX_INSERTION_SORT) {
+        swap_entries(a, 0, n / 2);
+        unsigned char pivot = a[0].key[depth];
+        int lt = 0, gt = n - 1, i = 1;
+        while (i <= gt) {
+            unsigned char c = a[i].key[depth];
+            if (c < pivot) swap_entries(a, lt++, i++);
+            else if (c > pivot) swap_entries(a, i, gt--);
+            else i++;
+        }
+
+        sort_keys(a, lt, depth);
+        sort_keys(a + gt + 1, n - gt - 1, depth);
+        // Las claves son distintas: un grupo que termina en este byte tiene un solo elemento
+        if (pivot == '\0') return;
+        a += lt;
+        n = gt - lt + 1;
+        depth++;
+    }
+
+    for (int i = 1; i < n; i++) {
+        sort_entry_t entry = a[i];
+        int j = i;
+        while (j > 0 && strcmp((const char *)a[j - 1].key + depth, (const char *)entry.key + depth) > 0) {
+            a[j] = a[j - 1];
+            j--;
+        }
+        a[j] = entry;
+    }
+}
+
+// Términos con páginas en esta pasada, en orden alfabético, con el peso de su
+// inicial para agruparlos. El resultado lo libera quien llama
+index_order_t *sort_index_terms(stroff_context_t *ctx, int *count) {
+    // Las claves van en un solo bloque
+    size_t key_bytes = 0;
+    int n = 0;
+    for (int i = 0; i < ctx->index_term_count; i++) {
+        if (ctx->index_terms[i].first < 0) continue;
+        key_bytes += strlen(ctx->index_terms[i].term) * 2 + 2;
+        n++;
+    }
+
+    sort_entry_t *entries = index_realloc(NULL, sizeof(sort_entry_t) * (size_t)(n ? n : 1));
+    unsigned char *keys = index_realloc(NULL, key_bytes ? key_bytes : 1);
+    unsigned char *key = keys;
+    n = 0;
+    for (int i = 0; i < ctx->index_term_count; i++) {
+        if (ctx->index_terms[i].first < 0) continue;
+        entries[n].key = key;
+        entries[n].term = i;
+        key = build_sort_key(ctx->index_terms[i].term, key);
+        n++;
+    }
+    sort_keys(entries, n, 0);
+
+    index_order_t *order = index_realloc(NULL, sizeof(index_order_t) * (size_t)(n ? n : 1));
+    for (int i = 0; i < n; i++) {
+        order[i].term = entries[i].term;
+        order[i].initial = entries[i].key[0];
+    }
+    free(keys);
+    free(entries);
+    *count = n;
+    return order;
+}
+
+// Encabezado del grupo de una clave: la inicial en mayúscula, o '#' para cifras y signos
+const char *index_group_heading(unsigned char weight, char *buffer) {
+    if (weight < 'a' || weight > 'z' + 1) return "#";
+    if (weight == 'o') return "Ñ";
+    buffer[0] = (char)toupper(weight <= 'n' ? weight : weight - 1);
+    buffer[1] = '\0';
+    return buffer;
+}
+
+// Lista "3, 7, 12" de un término; devuelve su longitud
+int format_index_pages(const stroff_context_t *ctx, const index_term_t *entry, char **buffer, int *capacity) {
+    int length = 0;
+    int previous = 0;
+    for (int i = entry->first; i >= 0; i = ctx->index_pages[i].next) {
+        int page = ctx->index_pages[i].page;
+        if (page == previous) continue;
+        if (length + 16 > *capacity) {
+            *capacity = *capacity ? *capacity * 2 : 256;
+            *buffer = index_realloc(*buffer, (size_t)*capacity);
+        }
+        length += snprintf(*buffer + length, 16, previous ? ", %d" : "%d", page);
+        previous = page;
+    }
+    return length;
+}
+
+static void output_index_entry(stroff_context_t *ctx, const char *term, const char *pages, int pages_len) {
+    int margin = ctx->params.left_margin;
+    int width = ctx->geometry.content_width;
+    int term_width = utf8_display_width(term) + 2;
+
+    check_page_break(ctx, 1);
+    output_spaces(ctx, margin + 2);
+    output_string(ctx, term);
+
+    // Término, puntos y páginas en una línea si caben
+    if (term_width + 3 + pages_len <= width) {
+        output_spaces(ctx, 1);
+        for (int i = term_width + 1; i < width - pages_len - 1; i++) {
+            output_raw(ctx, ".", 1);
+        }
+        output_spaces(ctx, 1);
+        output_raw(ctx, pages, pages_len);
+        output_newline(ctx);
+        return;
+    }
+
+    // Si no, las páginas siguen debajo, sangradas y cortadas tras cada coma
+    output_newline(ctx);
+    int room = width - 6;
+    if (room < 8) room = 8;
+    const char *p = pages;
+    while (pages_len > 0) {
+        int len = pages_len;
+        if (len > room) {
+            len = room;
+            while (len > 0 && p[len - 1] != ',') len--;
+            if (len == 0) len = room;
+        }
+        check_page_break(ctx, 1);
+        output_spaces(ctx, margin + 6);
+        output_raw(ctx, p, len);
+        output_newline(ctx);
+        p += len;
+        pages_len -= len;
+        while (pages_len > 0 && *p == ' ') {
+            p++;
+            pages_len--;
+        }
+    }
+}
+
+void output_index(stroff_context_t *ctx) {
+    check_page_break(ctx, 6);
+    output_newline(ctx);
+    output_string(ctx, "INDICE ALFABETICO");
+    output_newline(ctx);
+    output_string(ctx, "=================");
+    output_newline(ctx);
+
+    int count;
+    index_order_t *order = sort_index_terms(ctx, &count);
+
+    char *pages = NULL;
+    int capacity = 0;
+    char group[4] = "";
+    char letter[2];
+    for (int i = 0; i < count; i++) {
+        const index_term_t *entry = &ctx->index_terms[order[i].term];
+        const char *heading = index_group_heading(order[i].initial, letter);
+        if (i == 0 || strcmp(heading, group) != 0) {
+            // La inicial no se queda sola al final de la página
+            output_blank_line(ctx);
+            check_page_break(ctx, 2);
+            output_spaces(ctx, ctx->params.left_margin);
+            output_string(ctx, heading);
+            output_newline(ctx);
+            strcpy(group, heading);
+        }
+        int pages_len = format_index_pages(ctx, entry, &pages, &capacity);
+        output_index_entry(ctx, entry->term, pages, pages_len);
+    }
+    free(pages);
+    free(order);
+
+    check_page_break(ctx, 1);
+    output_newline(ctx);
+}
+
+void free_keyword_index(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->index_term_count; i++) {
+        free(ctx->index_terms[i].term);
+    }
+    free(ctx->index_terms);
+    free(ctx->index_slots);
+    free(ctx->index_pages);
+    ctx->index_terms = NULL;
+    ctx->index_term_count = 0;
+    ctx->index_term_capacity = 0;
+    ctx->index_slots = NULL;
+    ctx->index_slot_count = 0;
+    ctx->index_pages = NULL;
+    ctx->index_page_count = 0;
+    ctx->index_page_capacity = 0;
+}
@@ -0,0 +1,143 @@
+#include "stroff.h"
+
+// Referencias cruzadas: .LABEL "id" anota la página en la que está y {REF:id}
+// en el texto se sustituye por ella. Las etiquetas van en una tabla hash abierta
+// (FNV-1a, sondeo lineal) para que cada {REF:} cueste O(1) aunque el documento
+// tenga miles. Una {REF:} puede ir antes que su .LABEL, así que muestra la página
+// de la pasada anterior; la pasada de conteo se repite hasta que ninguna cambia
+
+#define LABEL_TABLE_INITIAL 64
+
+static unsigned int label_hash(const char *id, int len) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < len; i++) hash = (hash ^ (unsigned char)id[i]) * 16777619u;
+    return hash;
+}
+
+static int grow_labels(stroff_context_t *ctx) {
+    int size = ctx->label_size ? ctx->label_size * 2 : LABEL_TABLE_INITIAL;
+    label_t *table = calloc((size_t)size, sizeof(label_t));
+    if (!table) return 0;
+
+    for (int i = 0; i < ctx->label_size; i++) {
+        label_t *label = &ctx->labels[i];
+        if (!label->id) continue;
+        int slot = (int)(label->hash & (unsigned int)(size - 1));
+        while (table[slot].id) slot = (slot + 1) & (size - 1);
+        table[slot] = *label;
+    }
+    free(ctx->labels);
+    ctx->labels = table;
+    ctx->label_size = size;
+    return 1;
+}
+
+// Etiqueta id[0..len), creándola si no existe. NULL sin memoria
+static label_t *find_label(stroff_context_t *ctx, const char *id, int len) {
+    unsigned int hash = label_hash(id, len);
+    if (ctx->label_size > 0) {
+        int mask = ctx->label_size - 1;
+        for (int slot = (int)(hash & (unsigned int)mask); ctx->labels[slot].id; slot = (slot + 1) & mask) {
+            label_t *label = &ctx->labels[slot];
+            if (label->hash == hash && memcmp(label->id, id, (size_t)len) == 0 && label->id[len] == '\0') {
+                return label;
+            }
+        }
+    }
+
+    if ((ctx->label_count + 1) * 2 > ctx->label_size && !grow_labels(ctx)) return NULL;
+
+    char *copy = malloc((size_t)len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, id, (size_t)len);
+    copy[len] = '\0';
+
+    int mask = ctx->label_size - 1;
+    int slot = (int)(hash & (unsigned int)mask);
+    while (ctx->labels[slot].id) slot = (slot + 1) & mask;
+    label_t *label = &ctx->labels[slot];
+    memset(label, 0, sizeof(label_t));
+    label->hash = hash;
+    label->id = copy;
+    ctx->label_count++;
+    return label;
+}
+
+void define_label(stroff_context_t *ctx, const char *id) {
+    label_t *label = find_label(ctx, id, (int)strlen(id));
+    if (!label) return;
+
+    if (label->defined) {
+        // El recorrido previo lee el documento entero: avisa una sola vez
+        if (ctx->outline_only) {
+            report_error(ctx, "La etiqueta '%s' está definida más de una vez", id);
+        }
+        return;
+    }
+    label->defined = 1;
+    // Sin maquetar se conserva la página de la última maquetación. Con la página
+    // llena, lo que sigue a la etiqueta empieza en la siguiente
+    if (!ctx->outline_only && ctx->layout_mode != LAYOUT_SKIP) {
+        label->page = ctx->current_page + (page_lines_remaining(ctx) <= 0);
+    }
+}
+
+// Texto de {REF:id}: la página conocida, o "??" si aún no se conoce
+const char *label_reference(stroff_context_t *ctx, const char *id, int len, char *buffer, int size) {
+    ctx->needs_label_pages = 1;
+    label_t *label = find_label(ctx, id, len);
+    if (!label) return "??";
+
+    label->referenced = 1;
+    if (label->known_page <= 0) return "??";
+    snprintf(buffer, (size_t)size, "%d", label->known_page);
+    return buffer;
+}
+
+// Página leída de --map: la primera pasada la usa como conocida
+void set_label_page(stroff_context_t *ctx, const char *id, int page) {
+    label_t *label = find_label(ctx, id, (int)strlen(id));
+    if (label) label->page = page;
+}
+
+// Al empezar cada pasada las páginas anotadas pasan a ser las que muestran las {REF:}
+void begin_label_pass(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->label_size; i++) {
+        label_t *label = &ctx->labels[i];
+        label->known_page = label->page;
+        label->defined = 0;
+        label->referenced = 0;
+    }
+}
+
+// Alguna {REF:} de la pasada mostró una página distinta de la de su .LABEL
+int labels_changed(const stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->label_size; i++) {
+        const label_t *label = &ctx->labels[i];
+        if (label->referenced && label->defined && label->page != label->known_page) return 1;
+    }
+    return 0;
+}
+
+// Todas las {REF:} sin .LABEL de la pasada en un solo aviso
+void report_unresolved_labels(const stroff_context_t *ctx) {
+    int count = 0;
+    for (int i = 0; i < ctx->label_size; i++) {
+        const label_t *label = &ctx->labels[i];
+        if (!label->id || !label->referenced || label->defined) continue;
+        if (count == 0) begin_error(ctx);
+        fprintf(stderr, count == 0 ? "Referencias a etiquetas sin .LABEL: %s" : ", %s", label->id);
+        count++;
+    }
+    if (count > 0) fputc('\n', stderr);
+}
+
+void free_labels(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->label_size; i++) {
+        free(ctx->labels[i].id);
+    }
+    free(ctx->labels);
+    ctx->labels = NULL;
+    ctx->label_size = 0;
+    ctx->label_count = 0;
+}
@@ -0,0 +1,163 @@
+#include "stroff.h"
+
+// Analizador de argumentos de comandos. La línea se recorre una sola vez: cada
+// argumento queda como palabra, entero, cadena entre comillas o CLAVE=valor, con
+// su texto terminado en '\0' dentro de la copia de la línea que guarda el propio
+// command_line_t. Los manejadores consultan el primer argumento de cada tipo y las
+// claves conocidas por índice, sin recorrer la línea otra vez ni reservar memoria
+
+static const char *const command_key_names[COMMAND_KEY_COUNT] = {
+    "COLS", "WIDTHS", "ALIGNS", "NAME", "SEP", "HEADER", "TYPE"
+};
+static const int command_key_lengths[COMMAND_KEY_COUNT] = { 4, 6, 6, 4, 3, 6, 4 };
+
+// Clases de carácter en una tabla para no llamar a isspace() por cada byte:
+// SPACE separa argumentos y STOP además termina una palabra ('=', '\0')
+enum { CHAR_SPACE = 1, CHAR_STOP = 2 };
+static const unsigned char char_class[256] = {
+    ['\0'] = CHAR_STOP,
+    [' '] = CHAR_SPACE | CHAR_STOP, ['\t'] = CHAR_SPACE | CHAR_STOP, ['\n'] = CHAR_SPACE | CHAR_STOP,
+    ['\v'] = CHAR_SPACE | CHAR_STOP, ['\f'] = CHAR_SPACE | CHAR_STOP, ['\r'] = CHAR_SPACE | CHAR_STOP,
+    ['='] = CHAR_STOP
+};
+
+#define IS_SPACE(c) (char_class[(unsigned char)(c)] & CHAR_SPACE)
+#define IS_STOP(c)  (char_class[(unsigned char)(c)] & CHAR_STOP)
+
+static int find_command_key(const char *key, int len) {
+    for (int i = 0; i < COMMAND_KEY_COUNT; i++) {
+        if (command_key_lengths[i] == len && memcmp(command_key_names[i], key, (size_t)len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Devuelve 1 si text es un entero completo. value recibe siempre los dígitos
+// iniciales, como atoi ("30abc" vale 30 y "abc" vale 0)
+static int parse_int_token(const char *text, long *value) {
+    const char *p = text;
+    *value = strtol(text, NULL, 10);
+    if (*p == '-') p++;
+    if (!isdigit((unsigned char)*p)) return 0;
+    while (isdigit((unsigned char)*p)) p++;
+    return *p == '\0';
+}
+
+// Cadena entre comillas que empieza en p (en la comilla). Devuelve lo que sigue a
+// la comilla de cierre, o NULL si no la hay
+static char *lex_quoted(char *p, command_token_t *token) {
+    char *end = strchr(p + 1, '"');
+    if (!end) return NULL;
+    *end = '\0';
+    token->text = p + 1;
+    token->length = (int)(end - p - 1);
+    return end + 1;
+}
+
+static void add_token(command_line_t *cmd, const command_token_t *token) {
+    int index = cmd->token_count;
+    if (index >= MAX_COMMAND_TOKENS) return;
+    cmd->tokens[cmd->token_count++] = *token;
+
+    switch (token->type) {
+        case TOKEN_STRING: if (cmd->first_string < 0) cmd->first_string = index; break;
+        case TOKEN_INT:    if (cmd->first_int < 0) cmd->first_int = index; break;
+        case TOKEN_WORD:   if (cmd->first_word < 0) cmd->first_word = index; break;
+        case TOKEN_KEY_VALUE:
+            if (token->key >= 0 && cmd->keys[token->key] < 0) cmd->keys[token->key] = index;
+            break;
+    }
+}
+
+// line empieza por '.'. Una cadena sin comilla de cierre termina el análisis:
+// el comando se queda sin ese argumento
+void lex_command(const char *line, command_line_t *cmd) {
+    cmd->token_count = 0;
+    cmd->first_string = -1;
+    cmd->first_int = -1;
+    cmd->first_word = -1;
+    for (int i = 0; i < COMMAND_KEY_COUNT; i++) {
+        cmd->keys[i] = -1;
+    }
+
+    size_t len = strlen(line);
+    if (len >= sizeof(cmd->text)) len = sizeof(cmd->text) - 1;
+    memcpy(cmd->text, line, len);
+    cmd->text[len] = '\0';
+
+    char *p = cmd->text + (cmd->text[0] == '.');
+    char *name = p;
+    while (*p && !IS_SPACE(*p)) p++;
+    size_t name_len = (size_t)(p - name);
+    if (name_len >= MAX_COMMAND_LENGTH) name_len = MAX_COMMAND_LENGTH - 1;
+    memcpy(cmd->name, name, name_len);
+    cmd->name[name_len] = '\0';
+
+    while (p) {
+        while (IS_SPACE(*p)) p++;
+        if (!*p) break;
+
+        command_token_t token;
+        token.key = -1;
+        token.number = 0;
+
+        if (*p == '"') {
+            token.type = TOKEN_STRING;
+            p = lex_quoted(p, &token);
+            if (p) add_token(cmd, &token);
+            continue;
+        }
+
+        char *start = p;
+        while (!IS_STOP(*p)) p++;
+
+        if (*p == '=') {
+            token.type = TOKEN_KEY_VALUE;
+            token.key = find_command_key(start, (int)(p - start));
+            p++;
+            if (*p == '"') {
+                p = lex_quoted(p, &token);
+                if (!p) break;
+            } else {
+                token.text = p;
+                while (*p && !IS_SPACE(*p)) p++;
+                token.length = (int)(p - token.text);
+                if (*p) *p++ = '\0';
+            }
+            parse_int_token(token.text, &token.number);
+            add_token(cmd, &token);
+            continue;
+        }
+
+        token.text = start;
+        token.length = (int)(p - start);
+        if (*p) *p++ = '\0';
+        token.type = parse_int_token(token.text, &token.number) ? TOKEN_INT : TOKEN_WORD;
+        add_token(cmd, &token);
+    }
+}
+
+const char *command_string(const command_line_t *cmd) {
+    return cmd->first_string >= 0 ? cmd->tokens[cmd->first_string].text : NULL;
+}
+
+const char *command_word(const command_line_t *cmd) {
+    return cmd->first_word >= 0 ? cmd->tokens[cmd->first_word].text : NULL;
+}
+
+// Sin argumento entero se toman los dígitos iniciales de la primera palabra, como
+// atoi ("30abc" vale 30), o 0
+int command_int(const command_line_t *cmd) {
+    if (cmd->first_int >= 0) return (int)cmd->tokens[cmd->first_int].number;
+    return cmd->first_word >= 0 ? (int)cmd->tokens[cmd->first_word].number : 0;
+}
+
+const command_token_t *command_key(const command_line_t *cmd, command_key_t key) {
+    return cmd->keys[key] >= 0 ? &cmd->tokens[cmd->keys[key]] : NULL;
+}
+
+int command_key_int(const command_line_t *cmd, command_key_t key) {
+    const command_token_t *token = command_key(cmd, key);
+    return token ? (int)token->number : 0;
+}
@@ -0,0 +1,440 @@
+#include "stroff.h"
+
+// Variables de usuario (.DEFINE) y macros con parámetros (.MACRO/.EMACRO).
+// El cuerpo de una macro se trocea en literales y referencias al definirla; cada
+// uso solo copia los trozos con los argumentos y ejecuta las líneas resultantes
+
+static void *macro_realloc(void *data, size_t size) {
+    void *grown = realloc(data, size);
+    if (!grown) {
+        fprintf(stderr, "Error: Memoria insuficiente para las macros\n");
+        exit(1);
+    }
+    return grown;
+}
+
+static char *macro_strdup(const char *text, int len) {
+    char *copy = macro_realloc(NULL, (size_t)len + 1);
+    memcpy(copy, text, (size_t)len);
+    copy[len] = '\0';
+    return copy;
+}
+
+static int is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// Longitud del nombre entre llaves en text ("{NOMBRE}..."), 0 si no lo es
+static int reference_length(const char *text) {
+    if (text[0] != '{') return 0;
+
+    int len = 1;
+    while (is_name_char(text[len])) len++;
+    return len > 1 && text[len] == '}' ? len - 1 : 0;
+}
+
+const char *lookup_define(stroff_context_t *ctx, const char *name, int len) {
+    for (int i = 0; i < ctx->define_count; i++) {
+        if ((int)strlen(ctx->defines[i].name) == len && strncmp(ctx->defines[i].name, name, len) == 0) {
+            return ctx->defines[i].value;
+        }
+    }
+    return NULL;
+}
+
+static void set_define(stroff_context_t *ctx, const char *name, const char *value) {
+    for (int i = 0; i < ctx->define_count; i++) {
+        if (strcmp(ctx->defines[i].name, name) == 0) {
+            free(ctx->defines[i].value);
+            ctx->defines[i].value = macro_strdup(value, (int)strlen(value));
+            return;
+        }
+    }
+
+    if (ctx->define_count == ctx->define_capacity) {
+        ctx->define_capacity = ctx->define_capacity ? ctx->define_capacity * 2 : 16;
+        ctx->defines = macro_realloc(ctx->defines, sizeof(define_t) * ctx->define_capacity);
+    }
+    define_t *define = &ctx->defines[ctx->define_count++];
+    define->name = macro_strdup(name, (int)strlen(name));
+    define->value = macro_strdup(value, (int)strlen(value));
+}
+
+static int append_text(char *out, int pos, int out_size, const char *text, int len) {
+    if (pos + len > out_size - 1) {
+        len = out_size - 1 - pos;
+    }
+    if (len > 0) {
+        memcpy(out + pos, text, (size_t)len);
+        pos += len;
+    }
+    return pos;
+}
+
+// {NOMBRE} de las variables definidas; las llaves sin variable se dejan como están
+// (p.ej. {PAGE} en .HEADER, que se resuelve al escribir cada página)
+// {REF:id} se sustituye por la página de la etiqueta (label.c)
+const char *expand_variables(stroff_context_t *ctx, const char *line, char *out, int out_size) {
+    if (!strchr(line, '{')) return line;
+    if (ctx->define_count == 0 && !strstr(line, "{REF:")) return line;
+
+    int pos = 0;
+    const char *literal = line;
+    const char *p = line;
+    char page[16];
+
+    while ((p = strchr(p, '{')) != NULL) {
+        int len = 0;
+        const char *value = NULL;
+        if (strncmp(p, "{REF:", 5) == 0) {
+            const char *end = strchr(p + 5, '}');
+            if (end && end > p + 5) {
+                value = label_reference(ctx, p + 5, (int)(end - p - 5), page, sizeof(page));
+                len = (int)(end - p) - 1;
+            }
+        } else {
+            len = reference_length(p);
+            value = len ? lookup_define(ctx, p + 1, len) : NULL;
+        }
+        if (!value) {
+            p++;
+            continue;
+        }
+
+        pos = append_text(out, pos, out_size, literal, (int)(p - literal));
+        pos = append_text(out, pos, out_size, value, (int)strlen(value));
+        p += len + 2;
+        literal = p;
+    }
+
+    pos = append_text(out, pos, out_size, literal, (int)strlen(literal));
+    out[pos] = '\0';
+    return out;
+}
+
+static macro_t *find_macro(stroff_context_t *ctx, const char *name) {
+    for (int i = 0; i < ctx->macro_count; i++) {
+        if (strcmp(ctx->macros[i].name, name) == 0) {
+            return &ctx->macros[i];
+        }
+    }
+    return NULL;
+}
+
+static void free_macro_body(macro_t *macro) {
+    for (int i = 0; i < macro->line_count; i++) {
+        free(macro->lines[i].source);
+        free(macro->lines[i].segments);
+    }
+    free(macro->lines);
+    macro->lines = NULL;
+    macro->line_count = 0;
+    macro->line_capacity = 0;
+}
+
+static void add_segment(macro_line_t *line, int *capacity, macro_segment_type_t type, int offset, int length, int param) {
+    if (type == MACRO_SEG_LITERAL && length <= 0) return;
+
+    if (line->segment_count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 4;
+        line->segments = macro_realloc(line->segments, sizeof(macro_segment_t) * *capacity);
+    }
+    macro_segment_t *segment = &line->segments[line->segment_count++];
+    segment->type = type;
+    segment->offset = offset;
+    segment->length = length;
+    segment->param = param;
+}
+
+static void compile_macro_line(const macro_t *macro, macro_line_t *line, const char *text) {
+    line->source = macro_strdup(text, (int)strlen(text));
+    line->segments = NULL;
+    line->segment_count = 0;
+
+    const char *src = line->source;
+    int capacity = 0;
+    int literal_start = 0;
+    int has_references = 0;
+    int i = 0;
+
+    while (src[i]) {
+        int len = reference_length(src + i);
+        if (!len) {
+            i++;
+            continue;
+        }
+
+        macro_segment_type_t type = MACRO_SEG_VARIABLE;
+        int param = -1;
+        for (int j = 0; j < macro->param_count; j++) {
+            if ((int)strlen(macro->params[j]) == len && strncmp(macro->params[j], src + i + 1, len) == 0) {
+                type = MACRO_SEG_PARAM;
+                param = j;
+                break;
+            }
+        }
+
+        add_segment(line, &capacity, MACRO_SEG_LITERAL, literal_start, i - literal_start, -1);
+        add_segment(line, &capacity, type, i + 1, len, param);
+        has_references = 1;
+        i += len + 2;
+        literal_start = i;
+    }
+
+    if (has_references) {
+        add_segment(line, &capacity, MACRO_SEG_LITERAL, literal_start, i - literal_start, -1);
+    }
+}
+
+// Devuelve 1 si la línea pertenece al cuerpo de la macro que se está definiendo
+int record_macro_line(stroff_context_t *ctx, const char *line) {
+    if (ctx->recording_macro < 0) return 0;
+
+    macro_t *macro = &ctx->macros[ctx->recording_macro];
+    const char *trimmed = line;
+    while (isspace((unsigned char)*trimmed)) trimmed++;
+
+    if (strncmp(trimmed, ".EMACRO", 7) == 0 && (trimmed[7] == '\0' || isspace((unsigned char)trimmed[7]))) {
+        ctx->recording_macro = -1;
+        return 1;
+    }
+
+    if (macro->line_count == macro->line_capacity) {
+        macro->line_capacity = macro->line_capacity ? macro->line_capacity * 2 : 8;
+        macro->lines = macro_realloc(macro->lines, sizeof(macro_line_t) * macro->line_capacity);
+    }
+    compile_macro_line(macro, &macro->lines[macro->line_count++], line);
+    return 1;
+}
+
+// .MACRO NOMBRE [PARAM...]: las líneas hasta .EMACRO forman el cuerpo
+static void begin_macro(stroff_context_t *ctx, const char *line) {
+    char name[MAX_COMMAND_LENGTH];
+    const char *p = line + strlen(".MACRO");
+    int offset = 0;
+
+    // Todas las pasadas leen las mismas líneas: basta con avisar en la primera
+    if (ctx->macro_depth > 0) {
+        if (ctx->outline_only) {
+            report_error(ctx, "No se puede definir una macro dentro de otra");
+        }
+        return;
+    }
+    if (sscanf(p, " %63s%n", name, &offset) != 1) {
+        if (ctx->outline_only) {
+            report_error(ctx, ".MACRO sin nombre");
+        }
+        return;
+    }
+    p += offset;
+
+    macro_t *macro = find_macro(ctx, name);
+    if (macro) {
+        free_macro_body(macro);
+    } else {
+        if (ctx->macro_count == ctx->macro_capacity) {
+            ctx->macro_capacity = ctx->macro_capacity ? ctx->macro_capacity * 2 : 8;
+            ctx->macros = macro_realloc(ctx->macros, sizeof(macro_t) * ctx->macro_capacity);
+        }
+        macro = &ctx->macros[ctx->macro_count++];
+        memset(macro, 0, sizeof(*macro));
+        strcpy(macro->name, name);
+    }
+
+    macro->param_count = 0;
+    char param[MAX_COMMAND_LENGTH];
+    while (sscanf(p, " %63s%n", param, &offset) == 1) {
+        if (macro->param_count == MAX_MACRO_PARAMS) {
+            if (ctx->outline_only) {
+                report_error(ctx, "La macro '%s' tiene demasiados parámetros (máximo %d)", name, MAX_MACRO_PARAMS);
+            }
+            break;
+        }
+        strcpy(macro->params[macro->param_count++], param);
+        p += offset;
+    }
+
+    ctx->recording_macro = (int)(macro - ctx->macros);
+}
+
+// Argumentos de una llamada: palabras sueltas o texto entre comillas
+static int parse_macro_args(const char *p, char *buffer, const char *args[MAX_MACRO_PARAMS]) {
+    int count = 0;
+    int pos = 0;
+
+    while (count < MAX_MACRO_PARAMS) {
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+
+        const char *start = p;
+        const char *end;
+        if (*p == '"') {
+            start = p + 1;
+            end = strchr(start, '"');
+            if (!end) end = start + strlen(start);
+            p = *end ? end + 1 : end;
+        } else {
+            while (*p && !isspace((unsigned char)*p)) p++;
+            end = p;
+        }
+
+        args[count++] = buffer + pos;
+        memcpy(buffer + pos, start, (size_t)(end - start));
+        pos += (int)(end - start);
+        buffer[pos++] = '\0';
+    }
+    return count;
+}
+
+static void expand_macro(stroff_context_t *ctx, const macro_t *macro, const char *line) {
+    if (ctx->macro_depth >= MAX_MACRO_DEPTH) {
+        if (ctx->outline_only) {
+            report_error(ctx, "Límite de expansión de macros excedido en '%s' (%d niveles)",
+                    macro->name, MAX_MACRO_DEPTH);
+        }
+        return;
+    }
+
+    char arg_buffer[MAX_LINE_LENGTH];
+    const char *args[MAX_MACRO_PARAMS];
+    int arg_count = parse_macro_args(line + 1 + strlen(macro->name), arg_buffer, args);
+
+    ctx->macro_depth++;
+    for (int i = 0; i < macro->line_count && !ctx->stop_processing; i++) {
+        const macro_line_t *body = &macro->lines[i];
+        if (body->segment_count == 0) {
+            process_expanded_line(ctx, body->source);
+            continue;
+        }
+
+        char expanded[MAX_LINE_LENGTH];
+        int pos = 0;
+        for (int s = 0; s < body->segment_count; s++) {
+            const macro_segment_t *segment = &body->segments[s];
+            const char *value = NULL;
+
+            if (segment->type == MACRO_SEG_PARAM) {
+                value = segment->param < arg_count ? args[segment->param] : "";
+            } else if (segment->type == MACRO_SEG_VARIABLE) {
+                value = lookup_define(ctx, body->source + segment->offset, segment->length);
+            }
+
+            if (value) {
+                pos = append_text(expanded, pos, MAX_LINE_LENGTH, value, (int)strlen(value));
+            } else if (segment->type == MACRO_SEG_VARIABLE) {
+                // Variable sin definir: las llaves se conservan
+                pos = append_text(expanded, pos, MAX_LINE_LENGTH, body->source + segment->offset - 1, segment->length + 2);
+            } else {
+                pos = append_text(expanded, pos, MAX_LINE_LENGTH, body->source + segment->offset, segment->length);
+            }
+        }
+        expanded[pos] = '\0';
+        process_expanded_line(ctx, expanded);
+    }
+    ctx->macro_depth--;
+}
+
+// .DEFINE, .MACRO, .EMACRO y llamadas a macros. Devuelve 1 si la línea era una de ellas.
+// Una macro con el nombre de un comando lo sustituye
+int handle_macro_command(stroff_context_t *ctx, const char *line) {
+    char command[MAX_COMMAND_LENGTH];
+    if (sscanf(line, ".%63s", command) != 1) return 0;
+
+    if (strcmp(command, "DEFINE") == 0) {
+        char name[MAX_COMMAND_LENGTH];
+        int offset = 0;
+        if (sscanf(line, ".DEFINE %63[A-Za-z0-9_]%n", name, &offset) != 1) {
+            if (ctx->outline_only) {
+                report_error(ctx, ".DEFINE sin nombre");
+            }
+            return 1;
+        }
+        const char *rest = line + offset;
+        while (isspace((unsigned char)*rest)) rest++;
+        if (*rest == '"') {
+            command_line_t cmd;
+            lex_command(line, &cmd);
+            const char *value = command_string(&cmd);
+            set_define(ctx, name, value ? value : "");
+        } else if (*rest) {
+            // Sin comillas el valor es el resto de la línea
+            int length = (int)strlen(rest);
+            while (length > 0 && isspace((unsigned char)rest[length - 1])) length--;
+            char *value = macro_strdup(rest, length);
+            set_define(ctx, name, value);
+            free(value);
+        } else if (ctx->outline_only) {
+            report_error(ctx, ".DEFINE %s sin valor", name);
+        }
+        return 1;
+    }
+    if (strcmp(command, "MACRO") == 0) {
+        begin_macro(ctx, line);
+        return 1;
+    }
+    if (strcmp(command, "EMACRO") == 0) {
+        if (ctx->outline_only) {
+            report_error(ctx, ".EMACRO sin .MACRO");
+        }
+        return 1;
+    }
+
+    const macro_t *macro = ctx->macro_count > 0 ? find_macro(ctx, command) : NULL;
+    if (!macro) return 0;
+
+    expand_macro(ctx, macro, line);
+    return 1;
+}
+
+// -D NOMBRE=valor (o -D NOMBRE, que vale "1"). Se conserva entre pasadas
+void add_command_line_define(stroff_context_t *ctx, const char *spec) {
+    ctx->cli_defines = macro_realloc(ctx->cli_defines, sizeof(char *) * (size_t)(ctx->cli_define_count + 1));
+    ctx->cli_defines[ctx->cli_define_count++] = macro_strdup(spec, (int)strlen(spec));
+}
+
+static void apply_command_line_defines(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->cli_define_count; i++) {
+        const char *spec = ctx->cli_defines[i];
+        const char *equals = strchr(spec, '=');
+        int name_len = equals ? (int)(equals - spec) : (int)strlen(spec);
+        if (name_len >= MAX_COMMAND_LENGTH) name_len = MAX_COMMAND_LENGTH - 1;
+
+        char name[MAX_COMMAND_LENGTH];
+        memcpy(name, spec, (size_t)name_len);
+        name[name_len] = '\0';
+        set_define(ctx, name, equals ? equals + 1 : "1");
+    }
+}
+
+// Las definiciones se repiten en cada pasada: cada una empieza solo con las de -D
+void clear_macros(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->define_count; i++) {
+        free(ctx->defines[i].name);
+        free(ctx->defines[i].value);
+    }
+    for (int i = 0; i < ctx->macro_count; i++) {
+        free_macro_body(&ctx->macros[i]);
+    }
+    free(ctx->defines);
+    free(ctx->macros);
+    ctx->defines = NULL;
+    ctx->define_count = 0;
+    ctx->define_capacity = 0;
+    ctx->macros = NULL;
+    ctx->macro_count = 0;
+    ctx->macro_capacity = 0;
+    ctx->recording_macro = -1;
+    ctx->macro_depth = 0;
+
+    apply_command_line_defines(ctx);
+}
+
+void free_macros(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->cli_define_count; i++) {
+        free(ctx->cli_defines[i]);
+    }
+    free(ctx->cli_defines);
+    ctx->cli_defines = NULL;
+    ctx->cli_define_count = 0;
+    clear_macros(ctx);
+}
@@ -1,56 +1,403 @@
 #include "stroff.h"
 
+static void print_usage(const char *program) {
+    fprintf(stderr, "Uso: %s [opciones] <archivo.str> <archivo.txt>\n", program);
+    fprintf(stderr, "     %s --check [-D ...] [-I DIR] <archivo.str>...\n", program);
+    fprintf(stderr, "Opciones:\n");
+    fprintf(stderr, "  --pages A-B   Escribe solo las páginas A a B (A- hasta el final)\n");
+    fprintf(stderr, "  --chapter N   Escribe solo el capítulo N\n");
+    fprintf(stderr, "  --map FILE    Mapa de páginas: lo guarda una ejecución completa y lo usan\n");
+    fprintf(stderr, "                --pages/--chapter para no maquetar el resto del documento\n");
+    fprintf(stderr, "  --index FILE  Índice JSON con el offset de cada página, encabezado y tabla\n");
+    fprintf(stderr, "  --async-write Escribe la salida desde un hilo aparte, solapado con la maquetación\n");
+    fprintf(stderr, "  --io-stats    Con --async-write, informa del tiempo de E/S y del solapamiento\n");
+    fprintf(stderr, "  --html FILE   Escribe también el documento en HTML\n");
+    fprintf(stderr, "  --markdown FILE  Escribe también el documento en Markdown\n");
+    fprintf(stderr, "  --watch       Regenera la salida cada vez que cambia el documento o sus includes\n");
+    fprintf(stderr, "  --compile     Escribe en <salida> el documento precompilado (.stc), con los includes\n");
+    fprintf(stderr, "                resueltos; se renderiza pasándolo como <archivo.str>\n");
+    fprintf(stderr, "  --check       Valida los documentos sin maquetarlos (comandos, bloques sin\n");
+    fprintf(stderr, "                cerrar, includes, texto que se recortaría); varios en paralelo\n");
+    fprintf(stderr, "  -D NOMBRE[=valor]  Define una variable para .IF DEFINED() y {NOMBRE}\n");
+    fprintf(stderr, "  -I DIR        Busca también en DIR los archivos de .INCLUDE y .TABLEFILE\n");
+    fprintf(stderr, "  -M FILE       Escribe las dependencias (.INCLUDE, .TABLEFILE) en formato Makefile\n");
+}
+
+typedef struct {
+    const renderer_t *renderer;
+    const char *path;
+    FILE *file;
+} extra_output_t;
+
+static void close_extra_outputs(extra_output_t *extras, int count) {
+    for (int i = 0; i < count; i++) {
+        if (extras[i].file) {
+            fclose(extras[i].file);
+            extras[i].file = NULL;
+        }
+    }
+}
+
+// Descarta lo escrito en una salida para volver a escribirla desde el principio
+static FILE *reopen_output(FILE *file, const char *path) {
+    FILE *reopened = freopen(path, "w", file);
+    if (!reopened) {
+        fprintf(stderr, "Error: No se puede abrir el archivo de salida '%s'\n", path);
+    }
+    return reopened;
+}
+
+static int parse_page_range(const char *spec, int *first, int *last) {
+    char *end;
+    long from = strtol(spec, &end, 10);
+    if (end == spec || from < 1) return 0;
+
+    long to = from;
+    if (*end == '-') {
+        const char *rest = end + 1;
+        if (*rest == '\0') {
+            to = 0;
+        } else {
+            to = strtol(rest, &end, 10);
+            if (end == rest || *end != '\0' || to < from) return 0;
+        }
+    } else if (*end != '\0') {
+        return 0;
+    }
+
+    *first = (int)from;
+    *last = (int)to;
+    return 1;
+}
+
+// Vista previa: elige el encabezado donde reanudar la maquetación y dónde detenerse
+static int plan_preview(stroff_context_t *ctx, int chapter_number, int first_page,
+                        int *resume, int *stop) {
+    *resume = -1;
+    *stop = -1;
+
+    if (chapter_number > 0) {
+        int seen = 0;
+        for (int i = 0; i < ctx->chapter_count; i++) {
+            if (ctx->chapters[i].level != 1) continue;
+            seen++;
+            if (seen == chapter_number) {
+                *resume = i;
+            } else if (seen == chapter_number + 1) {
+                *stop = i;
+                break;
+            }
+        }
+        return *resume >= 0;
+    }
+
+    // Último encabezado tras el cual empieza la página pedida
+    for (int i = 0; i < ctx->chapter_count; i++) {
+        const chapter_t *chapter = &ctx->chapters[i];
+        if (chapter->page < first_page || (chapter->page == first_page && chapter->line == 0)) {
+            *resume = i;
+        }
+    }
+    return 1;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        fprintf(stderr, "Uso: %s <archivo.str> <archivo.txt>\n", argv[0]);
+    const char *input_path = NULL;
+    const char *output_path = NULL;
+    const char *map_path = NULL;
+    const char *depfile_path = NULL;
+    const char *index_path = NULL;
+    int first_page = 0;
+    int last_page = 0;
+    int chapter_number = 0;
+    int watch = 0;
+    int compile = 0;
+    int check = 0;
+    int async_write = 0;
+    int show_io_stats = 0;
+    io_stats_t io_stats = {0, 0};
+    int write_failed = 0;
+    extra_output_t extras[MAX_RENDER_TARGETS - 1];
+    int extra_count = 0;
+    const char *defines[argc];
+    int define_count = 0;
+    const char *include_dirs[argc];
+    int include_dir_count = 0;
+    const char *files[argc];
+    int file_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pages") == 0 && i + 1 < argc) {
+            if (!parse_page_range(argv[++i], &first_page, &last_page)) {
+                fprintf(stderr, "Error: Rango de páginas inválido '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--chapter") == 0 && i + 1 < argc) {
+            chapter_number = atoi(argv[++i]);
+            if (chapter_number < 1) {
+                fprintf(stderr, "Error: Número de capítulo inválido '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+            map_path = argv[++i];
+        } else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+            index_path = argv[++i];
+        } else if ((strcmp(argv[i], "--html") == 0 || strcmp(argv[i], "--markdown") == 0) && i + 1 < argc) {
+            if (extra_count >= MAX_RENDER_TARGETS - 1) {
+                fprintf(stderr, "Error: Demasiados formatos de salida (máximo %d)\n", MAX_RENDER_TARGETS);
+                return 1;
+            }
+            extras[extra_count].renderer = strcmp(argv[i], "--html") == 0 ? &html_renderer : &markdown_renderer;
+            extras[extra_count].path = argv[++i];
+            extras[extra_count].file = NULL;
+            extra_count++;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = 1;
+        } else if (strcmp(argv[i], "--compile") == 0) {
+            compile = 1;
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check = 1;
+        } else if (strcmp(argv[i], "--async-write") == 0) {
+            async_write = 1;
+        } else if (strcmp(argv[i], "--io-stats") == 0) {
+            show_io_stats = 1;
+        } else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc) {
+            include_dirs[include_dir_count++] = argv[++i];
+        } else if (strncmp(argv[i], "-I", 2) == 0 && argv[i][2] != '\0') {
+            include_dirs[include_dir_count++] = argv[i] + 2;
+        } else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc) {
+            depfile_path = argv[++i];
+        } else if (strcmp(argv[i], "-D") == 0 && i + 1 < argc) {
+            defines[define_count++] = argv[++i];
+        } else if (strncmp(argv[i], "-D", 2) == 0 && argv[i][2] != '\0') {
+            defines[define_count++] = argv[i] + 2;
+        } else {
+            files[file_count++] = argv[i];
+        }
+    }
+
+    // Sin salida: todos los archivos son documentos que validar
+    if (check) {
+        if (file_count == 0) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (watch || compile || extra_count > 0 || chapter_number > 0 || first_page > 0 || map_path ||
+            index_path || depfile_path || async_write) {
+            fprintf(stderr, "Error: --check solo admite -D e -I\n");
+            return 1;
+        }
+        return check_documents(files, file_count, defines, define_count, include_dirs, include_dir_count);
+    }
+
+    if (file_count != 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    input_path = files[0];
+    output_path = files[1];
+
+    // Los demás formatos no tienen páginas: siempre se escriben completos
+    if (extra_count > 0 && (chapter_number > 0 || first_page > 0)) {
+        fprintf(stderr, "Error: --html/--markdown no se pueden combinar con --pages/--chapter\n");
+        return 1;
+    }
+
+    // Los offsets solo valen para la salida completa
+    if (index_path && (chapter_number > 0 || first_page > 0)) {
+        fprintf(stderr, "Error: --index no se puede combinar con --pages/--chapter\n");
+        return 1;
+    }
+
+    if (watch && (extra_count > 0 || chapter_number > 0 || first_page > 0 || map_path || index_path || async_write)) {
+        fprintf(stderr, "Error: --watch solo admite la salida de texto completa\n");
+        return 1;
+    }
+
+    // Los parámetros de la ejecución (-D, formatos, páginas) se aplican al renderizar el .stc
+    if (compile && (watch || extra_count > 0 || chapter_number > 0 || first_page > 0 || map_path || index_path ||
+                    async_write || define_count > 0)) {
+        fprintf(stderr, "Error: --compile solo admite -I y -M\n");
         return 1;
     }
 
     stroff_context_t ctx;
     init_context(&ctx);
+    for (int i = 0; i < define_count; i++) {
+        add_command_line_define(&ctx, defines[i]);
+    }
+    clear_macros(&ctx);
+    for (int i = 0; i < include_dir_count; i++) {
+        add_include_dir(&ctx, include_dirs[i]);
+    }
+
+    if (compile) {
+        int ok = compile_document(&ctx, input_path, output_path);
+        if (ok && depfile_path) {
+            ok = write_depfile(&ctx, depfile_path, output_path);
+        }
+        free_context(&ctx);
+        return ok ? 0 : 1;
+    }
 
-    ctx.output = fopen("/dev/null", "w");
-    if (!ctx.output) {
-        fprintf(stderr, "Error: No se puede abrir /dev/null\n");
+    int compiled = open_compiled_document(&ctx, input_path);
+    if (compiled < 0 || (compiled > 0 && watch)) {
+        if (compiled > 0) fprintf(stderr, "Error: --watch necesita el documento fuente, no el compilado\n");
+        free_context(&ctx);
         return 1;
     }
 
-    process_file(&ctx, argv[1]);
-    fclose(ctx.output);
+    if (watch) {
+        int status = watch_document(&ctx, input_path, output_path, depfile_path);
+        free_context(&ctx);
+        return status;
+    }
+
+    // Recorrido previo: capítulos y tablas, para reservar el alto de TOC/TOT
+    ctx.outline_only = 1;
+    ctx.track_dependencies = depfile_path != NULL;
+    process_file(&ctx, input_path);
+    ctx.outline_only = 0;
 
-    // Guardar el total de páginas de la primera pasada
-    ctx.total_pages = ctx.current_page;
+    if (depfile_path && !write_depfile(&ctx, depfile_path, output_path)) {
+        free_context(&ctx);
+        return 1;
+    }
 
-    ctx.output = fopen(argv[2], "w");
-    if (!ctx.output) {
-        fprintf(stderr, "Error: No se puede abrir el archivo de salida '%s'\n", argv[2]);
+    FILE *output = fopen(output_path, "w");
+    if (!output) {
+        fprintf(stderr, "Error: No se puede abrir el archivo de salida '%s'\n", output_path);
+        free_context(&ctx);
         return 1;
     }
 
-    // Reinicializar todo el contexto para la segunda pasada
-    ctx.in_document = 0;
-    ctx.in_code_block = 0;
-    ctx.in_chapters = 0;
-    ctx.generate_toc = 0;
-    ctx.generate_tot = 0;
-    ctx.current_list.type = LIST_NONE;
-    ctx.current_list.item_count = 0;
-    ctx.current_table.row_count = 0;
-    ctx.current_paragraph_align = ALIGN_LEFT;
-    ctx.first_line_of_paragraph = 0;
-    ctx.current_page = 1;
-    ctx.current_line = 0;
-    strcpy(ctx.current_chapter, "");
-    strcpy(ctx.current_subchap, "");
-    strcpy(ctx.current_subsubchap, "");
-    ctx.include_depth = 0;
-    for (int i = 0; i < MAX_INCLUDE_DEPTH; i++) {
-        ctx.include_stack[i][0] = '\0';
+    for (int i = 0; i < extra_count; i++) {
+        extras[i].file = fopen(extras[i].path, "w");
+        if (!extras[i].file) {
+            fprintf(stderr, "Error: No se puede abrir el archivo de salida '%s'\n", extras[i].path);
+            close_extra_outputs(extras, extra_count);
+            fclose(output);
+            free_context(&ctx);
+            return 1;
+        }
+    }
+
+    // Los números de página de TOC/TOT se rellenan al final si la salida admite fseek.
+    // Solo hace falta una pasada de conteo si alguna plantilla usa {PAGES}.
+    ctx.use_fixups = ftell(output) >= 0;
+
+    int preview = chapter_number > 0 || first_page > 0;
+    int resume = -1;
+    int stop = -1;
+    int speculative = 0;
+
+    if (preview) {
+        // Vista previa: páginas del mapa de la última ejecución completa o,
+        // si no hay uno válido, una estimación que solo cuenta líneas
+        if (!map_path || !load_page_map(&ctx, map_path)) {
+            ctx.output = NULL;
+            begin_pass(&ctx);
+            ctx.layout_mode = LAYOUT_ESTIMATE;
+            process_file(&ctx, input_path);
+            flush_output(&ctx);
+            ctx.total_pages = ctx.current_page;
+        }
+
+        if (!plan_preview(&ctx, chapter_number, first_page, &resume, &stop)) {
+            fprintf(stderr, "Error: El documento no tiene capítulo %d\n", chapter_number);
+            fclose(output);
+            free_context(&ctx);
+            return 1;
+        }
+        if (chapter_number > 0) {
+            first_page = ctx.chapters[resume].page;
+            last_page = 0;
+        }
+    } else if ((ctx.needs_total_pages || ctx.needs_label_pages) && ctx.use_fixups && map_path &&
+               load_page_map(&ctx, map_path)) {
+        // Pasada especulativa: el total de páginas y las etiquetas del mapa de la
+        // última ejecución completa sustituyen a la pasada de conteo. La pasada final
+        // cuenta sus propias páginas (el total solo cambia el texto de headers/footers,
+        // no la maquetación) y, si no coinciden, se repite una vez con las reales
+        speculative = 1;
+    } else if (ctx.needs_total_pages || ctx.needs_label_pages || !ctx.use_fixups) {
+        count_pages(&ctx, input_path);
     }
-    // NOTA: NO reinicializar ctx.total_pages - mantiene el valor de la primera pasada
 
-    process_file(&ctx, argv[1]);
+    for (;;) {
+        ctx.output = output;
+        ctx.build_index = index_path != NULL;
+        begin_pass(&ctx);
+        ctx.first_output_page = first_page;
+        ctx.last_output_page = last_page;
+        if (preview) {
+            // Lo anterior al punto de reanudación solo actualiza el estado, sin maquetar
+            ctx.layout_mode = resume >= 0 ? LAYOUT_SKIP : LAYOUT_FULL;
+            ctx.resume_chapter = resume;
+            ctx.stop_chapter = stop;
+            ctx.stop_after_range = 1;
+        }
+        // Una sola interpretación del documento alimenta todos los formatos
+        ctx.target_count = 1;
+        for (int i = 0; i < extra_count; i++) {
+            add_render_target(&ctx, extras[i].renderer, extras[i].file);
+        }
+        if (async_write) {
+            ctx.writer = start_output_writer(output);
+            if (!ctx.writer) {
+                fprintf(stderr, "Error: No se puede iniciar el hilo de escritura; se escribe sin él\n");
+                async_write = 0;
+            }
+        }
+        process_file(&ctx, input_path);
+        render_close_code(&ctx);
+        flush_output(&ctx);
+        if (ctx.writer) {
+            if (!finish_output_writer(ctx.writer, output, &io_stats)) {
+                fprintf(stderr, "Error: No se puede escribir el archivo de salida '%s'\n", output_path);
+                write_failed = 1;
+            }
+            ctx.writer = NULL;
+        }
+        resolve_page_fixups(&ctx);
+
+        if (!speculative || (ctx.current_page == ctx.total_pages && !labels_changed(&ctx))) break;
+
+        // El total o alguna etiqueta supuestos no eran los reales: se descarta la salida y se repite la pasada
+        speculative = 0;
+        ctx.total_pages = ctx.current_page;
+        output = reopen_output(output, output_path);
+        int reopened = output != NULL;
+        for (int i = 0; i < extra_count; i++) {
+            extras[i].file = reopened ? reopen_output(extras[i].file, extras[i].path) : extras[i].file;
+            reopened = reopened && extras[i].file;
+        }
+        if (!reopened) {
+            if (output) fclose(output);
+            close_extra_outputs(extras, extra_count);
+            free_context(&ctx);
+            return 1;
+        }
+    }
+
+    // En una vista previa el documento no se lee entero: faltarían etiquetas
+    if (!preview) {
+        report_unresolved_labels(&ctx);
+    }
+    if (!preview && map_path) {
+        ctx.total_pages = ctx.current_page;
+        save_page_map(&ctx, map_path);
+    }
+    if (index_path) {
+        save_page_index(&ctx, index_path, output_path);
+    }
+
+    if (show_io_stats && async_write) {
+        print_io_stats(&io_stats);
+    }
 
     fclose(ctx.output);
-    return 0;
+    close_extra_outputs(extras, extra_count);
+    free_context(&ctx);
+    return write_failed;
 }
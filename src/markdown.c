@@ -0,0 +1,315 @@
+#include "stroff.h"
+
+// Backend Markdown (CommonMark con tablas GFM). La alineación de párrafos y los
+// saltos de página no tienen equivalente y se ignoran
+
+static void md_escape(FILE *out, const char *text) {
+    // Marcadores de bloque al inicio de línea
+    if (*text == '#' || *text == '>' || *text == '-' || *text == '+') {
+        fputc('\\', out);
+    }
+
+    // "1." o "1)" al inicio empezaría una lista numerada: se escapa el signo
+    const char *marker = text;
+    while (isdigit((unsigned char)*marker)) marker++;
+    if (marker == text || (*marker != '.' && *marker != ')') ||
+        (marker[1] != '\0' && marker[1] != ' ' && marker[1] != '\t')) {
+        marker = NULL;
+    }
+
+    for (const char *p = text; *p; p++) {
+        if (p == marker || strchr("\\`*_[]<|", *p)) {
+            fputc('\\', out);
+        }
+        fputc(*p, out);
+    }
+}
+
+// Cada bloque va separado del anterior por una línea en blanco
+static void md_begin_block(render_target_t *target) {
+    if (target->paragraph_open) {
+        target->paragraph_open = 0;
+        target->pending_blank = 1;
+    }
+    if (target->pending_blank) {
+        fputc('\n', target->output);
+        target->pending_blank = 0;
+    }
+}
+
+static void md_end_block(render_target_t *target) {
+    target->pending_blank = 1;
+}
+
+static void md_begin_document(stroff_context_t *ctx, render_target_t *target) {
+    FILE *out = target->output;
+
+    if (strlen(ctx->params.title) > 0) {
+        md_begin_block(target);
+        fputs("# ", out);
+        md_escape(out, ctx->params.title);
+        fputc('\n', out);
+        md_end_block(target);
+    }
+    if (strlen(ctx->params.author) > 0) {
+        md_begin_block(target);
+        fputc('*', out);
+        md_escape(out, ctx->params.author);
+        fputs("*\n", out);
+        md_end_block(target);
+    }
+    if (strlen(ctx->params.date) > 0) {
+        md_begin_block(target);
+        fputc('*', out);
+        md_escape(out, ctx->params.date);
+        fputs("*\n", out);
+        md_end_block(target);
+    }
+}
+
+static void md_heading(stroff_context_t *ctx, render_target_t *target, const char *title, int level, int index) {
+    (void)ctx;
+    (void)index;
+    md_begin_block(target);
+
+    // "#" queda para el título del documento
+    for (int i = 0; i <= level; i++) {
+        fputc('#', target->output);
+    }
+    fputc(' ', target->output);
+    md_escape(target->output, title);
+    fputc('\n', target->output);
+    md_end_block(target);
+}
+
+static void md_paragraph(stroff_context_t *ctx, render_target_t *target, align_t align) {
+    (void)ctx;
+    (void)align;
+    md_begin_block(target);
+}
+
+static void md_text(stroff_context_t *ctx, render_target_t *target, const char *text, align_t align) {
+    (void)ctx;
+    (void)align;
+    if (!target->paragraph_open) {
+        md_begin_block(target);
+        target->paragraph_open = 1;
+    }
+    md_escape(target->output, text);
+    fputc('\n', target->output);
+}
+
+static void md_line_break(stroff_context_t *ctx, render_target_t *target) {
+    (void)ctx;
+    // Una línea en blanco en el texto separa párrafos
+    if (target->paragraph_open) {
+        target->paragraph_open = 0;
+        md_end_block(target);
+    }
+}
+
+static void md_list_begin(stroff_context_t *ctx, render_target_t *target, list_type_t type) {
+    (void)ctx;
+    (void)type;
+    md_begin_block(target);
+}
+
+static void md_list_item(stroff_context_t *ctx, render_target_t *target, const char *prefix, const char *text) {
+    (void)prefix;
+    // Markdown no tiene números romanos: las listas RNUMBER se numeran en decimal
+    if (ctx->current_list.type == LIST_NUMBER || ctx->current_list.type == LIST_RNUMBER) {
+        fprintf(target->output, "%d. ", ctx->current_list.item_count + 1);
+    } else {
+        fputs("- ", target->output);
+    }
+    md_escape(target->output, text);
+    fputc('\n', target->output);
+}
+
+static void md_list_end(stroff_context_t *ctx, render_target_t *target) {
+    (void)ctx;
+    md_end_block(target);
+}
+
+static void md_table_cells(render_target_t *target, const table_t *table, int row) {
+    fputc('|', target->output);
+    for (int col = 0; col < table->cols; col++) {
+        fputc(' ', target->output);
+        md_escape(target->output, table_cell(table, row, col));
+        fputs(" |", target->output);
+    }
+    fputc('\n', target->output);
+}
+
+static void md_table_begin(stroff_context_t *ctx, render_target_t *target, const table_t *table) {
+    (void)ctx;
+    md_begin_block(target);
+
+    if (table->name[0]) {
+        fputs("**", target->output);
+        md_escape(target->output, table->name);
+        fputs("**\n\n", target->output);
+    }
+
+    // Las tablas GFM exigen cabecera: sin .TH se deja vacía
+    md_table_cells(target, table, -1);
+
+    fputc('|', target->output);
+    for (int col = 0; col < table->cols; col++) {
+        switch (table->aligns[col]) {
+            case ALIGN_CENTER: fputs(" :---: |", target->output); break;
+            case ALIGN_RIGHT: fputs(" ---: |", target->output); break;
+            default: fputs(" --- |", target->output); break;
+        }
+    }
+    fputc('\n', target->output);
+}
+
+static void md_table_row(stroff_context_t *ctx, render_target_t *target, const table_t *table, int row) {
+    (void)ctx;
+    md_table_cells(target, table, row);
+}
+
+static void md_table_end(stroff_context_t *ctx, render_target_t *target, const table_t *table) {
+    (void)ctx;
+    (void)table;
+    md_end_block(target);
+}
+
+// La valla del bloque tiene que ser más larga que cualquier racha de ` de su
+// contenido, así que las líneas se guardan hasta .ECODE y la valla se elige al final
+static void md_code_begin(stroff_context_t *ctx, render_target_t *target) {
+    (void)ctx;
+    md_begin_block(target);
+    target->code_open = 1;
+    target->code_length = 0;
+    target->code_backticks = 0;
+}
+
+static void md_code_line(stroff_context_t *ctx, render_target_t *target, const char *text) {
+    (void)ctx;
+    size_t length = strlen(text);
+    if (target->code_length + length + 1 > target->code_capacity) {
+        size_t capacity = target->code_capacity ? target->code_capacity : 4096;
+        while (target->code_length + length + 1 > capacity) capacity *= 2;
+        char *grown = realloc(target->code_buffer, capacity);
+        if (!grown) {
+            fprintf(stderr, "Error: Memoria insuficiente para el bloque de código\n");
+            return;
+        }
+        target->code_buffer = grown;
+        target->code_capacity = capacity;
+    }
+    memcpy(target->code_buffer + target->code_length, text, length);
+    target->code_length += length;
+    target->code_buffer[target->code_length++] = '\n';
+
+    int run = 0;
+    for (const char *p = text; *p; p++) {
+        run = *p == '`' ? run + 1 : 0;
+        if (run > target->code_backticks) target->code_backticks = run;
+    }
+}
+
+static void md_fence(render_target_t *target) {
+    int length = target->code_backticks < 3 ? 3 : target->code_backticks + 1;
+    for (int i = 0; i < length; i++) {
+        fputc('`', target->output);
+    }
+    fputc('\n', target->output);
+}
+
+static void md_code_end(stroff_context_t *ctx, render_target_t *target) {
+    (void)ctx;
+    // Un .ECODE sin bloque abierto no cierra nada
+    if (!target->code_open) return;
+    md_fence(target);
+    fwrite(target->code_buffer, 1, target->code_length, target->output);
+    md_fence(target);
+    target->code_open = 0;
+    target->code_length = 0;
+    md_end_block(target);
+}
+
+
+static void md_toc(stroff_context_t *ctx, render_target_t *target) {
+    md_begin_block(target);
+    fputs("**TABLA DE CONTENIDOS**\n\n", target->output);
+
+    for (int i = 0; i < ctx->chapter_count; i++) {
+        for (int j = 1; j < ctx->chapters[i].level; j++) {
+            fputs("  ", target->output);
+        }
+        fputs("- ", target->output);
+        md_escape(target->output, ctx->chapters[i].title);
+        fputc('\n', target->output);
+    }
+    md_end_block(target);
+}
+
+static void md_tot(stroff_context_t *ctx, render_target_t *target) {
+    md_begin_block(target);
+    fputs("**INDICE DE TABLAS**\n\n", target->output);
+
+    for (int i = 0; i < ctx->table_ref_count; i++) {
+        fputs("- ", target->output);
+        md_escape(target->output, ctx->table_refs[i].name);
+        fputc('\n', target->output);
+    }
+    md_end_block(target);
+}
+
+// Índice alfabético: la inicial en negrita y una lista por grupo. Las páginas son
+// las de la salida de texto
+static void md_index(stroff_context_t *ctx, render_target_t *target) {
+    md_begin_block(target);
+    fputs("**INDICE ALFABETICO**\n", target->output);
+
+    int count;
+    index_order_t *order = sort_index_terms(ctx, &count);
+    char *pages = NULL;
+    int capacity = 0;
+    char group[4] = "";
+    char letter[2];
+    for (int i = 0; i < count; i++) {
+        const index_term_t *entry = &ctx->index_terms[order[i].term];
+        const char *heading = index_group_heading(order[i].initial, letter);
+        if (i == 0 || strcmp(heading, group) != 0) {
+            fputs("\n**", target->output);
+            md_escape(target->output, heading);
+            fputs("**\n\n", target->output);
+            strcpy(group, heading);
+        }
+        format_index_pages(ctx, entry, &pages, &capacity);
+        fputs("- ", target->output);
+        md_escape(target->output, entry->term);
+        fprintf(target->output, ": %s\n", pages);
+    }
+    free(pages);
+    free(order);
+    md_end_block(target);
+}
+
+const renderer_t markdown_renderer = {
+    .name = "markdown",
+    .begin_document = md_begin_document,
+    .end_document = NULL,
+    .heading = md_heading,
+    .paragraph = md_paragraph,
+    .text = md_text,
+    .line_break = md_line_break,
+    .list_begin = md_list_begin,
+    .list_item = md_list_item,
+    .list_end = md_list_end,
+    .table_begin = md_table_begin,
+    .table_row = md_table_row,
+    .table_rule = NULL,
+    .table_end = md_table_end,
+    .code_begin = md_code_begin,
+    .code_line = md_code_line,
+    .code_end = md_code_end,
+    .toc = md_toc,
+    .tot = md_tot,
+    .index = md_index,
+    .page_break = NULL
+};
@@ -0,0 +1,315 @@
+#include "stroff.h"
+
+// Sin paginación (PAGEHEIGHT 0) todo el documento es una sola página:
+// se vuelca por bloques para no acumularlo entero en memoria
+#define PAGE_FLUSH_THRESHOLD 65536
+
+static void page_reserve(page_buffer_t *page, size_t extra) {
+    if (page->length + extra <= page->capacity) return;
+
+    size_t capacity = page->capacity ? page->capacity : 4096;
+    while (capacity < page->length + extra) {
+        capacity *= 2;
+    }
+
+    char *data = realloc(page->data, capacity);
+    if (!data) {
+        fprintf(stderr, "Error: Memoria insuficiente para el buffer de página\n");
+        exit(1);
+    }
+    page->data = data;
+    page->capacity = capacity;
+}
+
+static int page_in_output_range(stroff_context_t *ctx) {
+    if (ctx->first_output_page > 0 && ctx->current_page < ctx->first_output_page) return 0;
+    if (ctx->last_output_page > 0 && ctx->current_page > ctx->last_output_page) return 0;
+    return 1;
+}
+
+static void flush_page_block(stroff_context_t *ctx) {
+    int written = ctx->output && page_in_output_range(ctx);
+
+    if (written && ctx->page.length > 0) {
+        if (ctx->writer) {
+            writer_append(ctx->writer, ctx->page.data, ctx->page.length);
+        } else {
+            fwrite(ctx->page.data, 1, ctx->page.length, ctx->output);
+        }
+    }
+
+    // Los campos reservados de esta página pasan a offsets absolutos en el archivo;
+    // si la página no se escribe, se descartan
+    if (written) {
+        for (int i = ctx->fixup_pending; i < ctx->fixup_count; i++) {
+            ctx->fixups[i].offset += ctx->bytes_written;
+        }
+        ctx->bytes_written += (long)ctx->page.length;
+    } else {
+        ctx->fixup_count = ctx->fixup_pending;
+    }
+    ctx->fixup_pending = ctx->fixup_count;
+
+    ctx->page.length = 0;
+    ctx->page.header_length = 0;
+}
+
+void output_raw(stroff_context_t *ctx, const char *text, int len) {
+    if (len <= 0 || ctx->layout_mode != LAYOUT_FULL) return;
+    page_reserve(&ctx->page, (size_t)len);
+    memcpy(ctx->page.data + ctx->page.length, text, (size_t)len);
+    ctx->page.length += (size_t)len;
+}
+
+void output_string(stroff_context_t *ctx, const char *text) {
+    output_raw(ctx, text, (int)strlen(text));
+}
+
+void output_spaces(stroff_context_t *ctx, int count) {
+    if (count <= 0 || ctx->layout_mode != LAYOUT_FULL) return;
+    page_reserve(&ctx->page, (size_t)count);
+    memset(ctx->page.data + ctx->page.length, ' ', (size_t)count);
+    ctx->page.length += (size_t)count;
+}
+
+void output_newline(stroff_context_t *ctx) {
+    if (ctx->layout_mode == LAYOUT_SKIP) return;
+    if (ctx->layout_mode == LAYOUT_ESTIMATE) {
+        ctx->current_line++;
+        return;
+    }
+
+    output_raw(ctx, "\n", 1);
+    ctx->current_line++;
+
+    if (ctx->params.page_height <= 0 && ctx->page.length >= PAGE_FLUSH_THRESHOLD) {
+        flush_page_block(ctx);
+    }
+}
+
+void update_page_geometry(stroff_context_t *ctx) {
+    page_geometry_t *geometry = &ctx->geometry;
+    geometry->content_width = ctx->params.page_width - ctx->params.left_margin - ctx->params.right_margin;
+
+    // Reservar espacio para header y footer
+    geometry->header_lines = ctx->page.has_header ? 2 : 0;
+    geometry->footer_lines = (ctx->footer_template.segment_count > 0) ? 3 : 0;
+    geometry->body_lines = ctx->params.page_height - geometry->header_lines - geometry->footer_lines;
+}
+
+void start_page(stroff_context_t *ctx) {
+    if (ctx->layout_mode == LAYOUT_SKIP) return;
+
+    // Cualquier salida pendiente (p.ej. antes de .DOCUMENT) se vuelca tal cual
+    if (ctx->page.length > 0) {
+        flush_page_block(ctx);
+    }
+    record_page_offset(ctx);
+
+    // Header solo en capítulos, no en página de título
+    int has_header = ctx->header_template.segment_count > 0 && ctx->in_chapters;
+    if (ctx->page.has_header != has_header) {
+        ctx->page.has_header = has_header;
+        update_page_geometry(ctx);
+    }
+
+    if (has_header) {
+        if (ctx->layout_mode == LAYOUT_FULL) {
+            output_header(ctx);
+        }
+        output_raw(ctx, "\n", 1);
+    }
+    ctx->page.header_length = ctx->page.length;
+}
+
+void finish_page(stroff_context_t *ctx) {
+    if (ctx->layout_mode == LAYOUT_SKIP) return;
+
+    // Llenar líneas hasta el final de la página
+    if (ctx->params.page_height > 0) {
+        while (ctx->current_line < ctx->geometry.body_lines) {
+            output_newline(ctx);
+        }
+    }
+
+    if (ctx->layout_mode == LAYOUT_FULL) {
+        output_footer(ctx);
+    }
+    flush_page_block(ctx);
+}
+
+void new_page(stroff_context_t *ctx) {
+    if (ctx->layout_mode == LAYOUT_SKIP) return;
+
+    // Un salto explícito termina el bloque .KEEP
+    ctx->keep.active = 0;
+
+    finish_page(ctx);
+
+    // Cambiar a nueva página
+    ctx->current_page++;
+    ctx->current_line = 0;
+
+    if (ctx->stop_after_range && ctx->last_output_page > 0 && ctx->current_page > ctx->last_output_page) {
+        ctx->stop_processing = 1;
+    }
+
+    start_page(ctx);
+}
+
+// Traslada el bloque .KEEP en curso, aún sin escribir, al principio de una página nueva.
+// Sus campos reservados, capítulos y tablas pasan a la página nueva
+static void relocate_keep_block(stroff_context_t *ctx) {
+    keep_block_t *keep = &ctx->keep;
+    size_t length = ctx->page.length - keep->start_offset;
+    int lines = ctx->current_line - keep->start_line;
+
+    char *block = NULL;
+    if (length > 0) {
+        block = malloc(length);
+        if (!block) {
+            fprintf(stderr, "Error: Memoria insuficiente para el bloque .KEEP\n");
+            exit(1);
+        }
+        memcpy(block, ctx->page.data + keep->start_offset, length);
+    }
+
+    int fixup_count = ctx->fixup_count - keep->fixup_start;
+    page_fixup_t fixups[MAX_PAGE_FIXUPS];
+    for (int i = 0; i < fixup_count; i++) {
+        fixups[i] = ctx->fixups[keep->fixup_start + i];
+        fixups[i].offset -= (long)keep->start_offset;
+    }
+
+    ctx->page.length = keep->start_offset;
+    ctx->current_line = keep->start_line;
+    ctx->fixup_count = keep->fixup_start;
+    long written_before = ctx->bytes_written;
+    new_page(ctx);
+
+    size_t base = ctx->page.length;
+    // Desplazamiento del bloque en la salida, para los offsets de --index
+    long shift = (ctx->bytes_written - written_before) + (long)base - (long)keep->start_offset;
+    output_raw(ctx, block, (int)length);
+    free(block);
+    for (int i = 0; i < fixup_count; i++) {
+        fixups[i].offset += (long)base;
+        ctx->fixups[ctx->fixup_count++] = fixups[i];
+    }
+
+    for (int i = keep->chapter_start; i < ctx->chapter_index; i++) {
+        chapter_t *chapter = &ctx->chapters[i];
+        chapter->page = ctx->current_page;
+        chapter->line -= keep->start_line;
+        chapter->start_page = ctx->current_page;
+        chapter->start_line -= keep->start_line;
+        if (chapter->offset >= 0) chapter->offset += shift;
+    }
+    for (int i = keep->table_ref_start; i < ctx->table_ref_index; i++) {
+        ctx->table_refs[i].page = ctx->current_page;
+        if (ctx->table_refs[i].offset >= 0) ctx->table_refs[i].offset += shift;
+    }
+    for (int i = keep->index_page_start; i < ctx->index_page_count; i++) {
+        ctx->index_pages[i].page = ctx->current_page;
+    }
+
+    ctx->current_line = lines;
+    keep->start_offset = base;
+    keep->start_line = 0;
+    keep->fixup_start = ctx->fixup_count - fixup_count;
+}
+
+// Devuelve 1 si se empezó una página nueva (p.ej. para repetir la cabecera de una tabla)
+int check_page_break(stroff_context_t *ctx, int lines_needed) {
+    if (ctx->params.page_height <= 0 || ctx->layout_mode == LAYOUT_SKIP) return 0;
+
+    // Una página vacía no se corta: el bloque no cabría tampoco en la siguiente
+    if (ctx->current_line == 0 || ctx->current_line + lines_needed <= ctx->geometry.body_lines) return 0;
+
+    // Un bloque .KEEP que no cabe pasa entero a la página siguiente; si ni así cabe,
+    // se corta con normalidad
+    if (ctx->keep.active && ctx->keep.start_line > 0) {
+        relocate_keep_block(ctx);
+        if (ctx->current_line + lines_needed <= ctx->geometry.body_lines) return 0;
+    }
+
+    new_page(ctx);
+    return 1;
+}
+
+// Línea en blanco de separación: al final de una página llena se omite
+void output_blank_line(stroff_context_t *ctx) {
+    if (ctx->params.page_height > 0 && ctx->current_line >= ctx->geometry.body_lines) return;
+    output_newline(ctx);
+}
+
+void begin_keep(stroff_context_t *ctx) {
+    if (ctx->layout_mode == LAYOUT_SKIP || ctx->keep.active) return;
+
+    ctx->keep.active = 1;
+    ctx->keep.start_offset = ctx->page.length;
+    ctx->keep.start_line = ctx->current_line;
+    ctx->keep.fixup_start = ctx->fixup_count;
+    ctx->keep.chapter_start = ctx->chapter_index;
+    ctx->keep.table_ref_start = ctx->table_ref_index;
+    ctx->keep.index_page_start = ctx->index_page_count;
+}
+
+void end_keep(stroff_context_t *ctx) {
+    ctx->keep.active = 0;
+}
+
+int page_lines_remaining(stroff_context_t *ctx) {
+    if (ctx->params.page_height <= 0) return ctx->current_line + 1;
+    return ctx->geometry.body_lines - ctx->current_line;
+}
+
+void flush_output(stroff_context_t *ctx) {
+    if (ctx->page.length > 0) {
+        flush_page_block(ctx);
+    }
+    if (ctx->output) {
+        fflush(ctx->output);
+    }
+}
+
+void record_page_fixup(stroff_context_t *ctx, fixup_kind_t kind, int index) {
+    if (!ctx->use_fixups || ctx->layout_mode != LAYOUT_FULL || ctx->fixup_count >= MAX_PAGE_FIXUPS) return;
+
+    // Offset relativo al bloque de la página; flush_page_block lo hace absoluto
+    ctx->fixups[ctx->fixup_count].offset = (long)ctx->page.length;
+    ctx->fixups[ctx->fixup_count].kind = kind;
+    ctx->fixups[ctx->fixup_count].index = index;
+    ctx->fixup_count++;
+}
+
+void resolve_page_fixups(stroff_context_t *ctx) {
+    if (ctx->fixup_count == 0) return;
+
+    fflush(ctx->output);
+    long end = ftell(ctx->output);
+
+    for (int i = 0; i < ctx->fixup_count; i++) {
+        const page_fixup_t *fixup = &ctx->fixups[i];
+        int page = fixup->kind == FIXUP_CHAPTER ? ctx->chapters[fixup->index].page
+                                                : ctx->table_refs[fixup->index].page;
+
+        char field[16];
+        int len = snprintf(field, sizeof(field), "%*d", PAGE_NUMBER_WIDTH, page);
+        if (len != PAGE_NUMBER_WIDTH) {
+            // No cabe en el campo reservado: queda el número de la maquetación previa
+            report_error(ctx, "La página %d de '%s' no cabe en el índice (máximo %d caracteres)", page,
+                         fixup->kind == FIXUP_CHAPTER ? ctx->chapters[fixup->index].title
+                                                      : ctx->table_refs[fixup->index].name,
+                         PAGE_NUMBER_WIDTH);
+            continue;
+        }
+
+        fseek(ctx->output, fixup->offset, SEEK_SET);
+        fwrite(field, 1, len, ctx->output);
+    }
+
+    fseek(ctx->output, end, SEEK_SET);
+    ctx->fixup_count = 0;
+    ctx->fixup_pending = 0;
+}
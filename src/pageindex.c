@@ -0,0 +1,95 @@
+#include "stroff.h"
+
+// --index: índice JSON de la salida de texto para visores con acceso aleatorio.
+// Guarda el offset y la longitud de cada página y el offset de cada encabezado y
+// tabla con nombre, tomados al escribir la pasada final; los campos de número de
+// página de TOC/TOT tienen ancho fijo, así que rellenarlos no mueve ningún offset
+
+// Byte de la salida en la posición actual, o -1 si la pasada no escribe el índice
+long output_offset(stroff_context_t *ctx) {
+    if (!ctx->build_index || !ctx->output || ctx->layout_mode != LAYOUT_FULL) return -1;
+    return ctx->bytes_written + (long)ctx->page.length;
+}
+
+// Se llama al empezar cada página, con el bloque anterior ya escrito
+void record_page_offset(stroff_context_t *ctx) {
+    long offset = output_offset(ctx);
+    if (offset < 0) return;
+
+    if (ctx->page_offset_count == ctx->page_offset_capacity) {
+        int capacity = ctx->page_offset_capacity ? ctx->page_offset_capacity * 2 : 64;
+        page_offset_t *grown = realloc(ctx->page_offsets, sizeof(page_offset_t) * (size_t)capacity);
+        if (!grown) {
+            fprintf(stderr, "Error: Memoria insuficiente para el índice de páginas\n");
+            exit(1);
+        }
+        ctx->page_offsets = grown;
+        ctx->page_offset_capacity = capacity;
+    }
+
+    page_offset_t *entry = &ctx->page_offsets[ctx->page_offset_count++];
+    entry->page = ctx->current_page;
+    entry->offset = offset;
+}
+
+static void write_json_string(FILE *file, const char *text) {
+    fputc('"', file);
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', file);
+            fputc(*p, file);
+        } else if (*p < 0x20) {
+            fprintf(file, "\\u%04x", *p);
+        } else {
+            fputc(*p, file);
+        }
+    }
+    fputc('"', file);
+}
+
+int save_page_index(stroff_context_t *ctx, const char *path, const char *output_path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: No se puede escribir el índice '%s'\n", path);
+        return 0;
+    }
+
+    fputs("{\n  \"version\": 1,\n  \"output\": ", file);
+    write_json_string(file, output_path);
+    fprintf(file, ",\n  \"size\": %ld,\n  \"pages\": [", ctx->bytes_written);
+    for (int i = 0; i < ctx->page_offset_count; i++) {
+        const page_offset_t *entry = &ctx->page_offsets[i];
+        long end = i + 1 < ctx->page_offset_count ? ctx->page_offsets[i + 1].offset : ctx->bytes_written;
+        fprintf(file, "%s\n    {\"page\": %d, \"offset\": %ld, \"length\": %ld}",
+                i > 0 ? "," : "", entry->page, entry->offset, end - entry->offset);
+    }
+
+    fputs("\n  ],\n  \"headings\": [", file);
+    for (int i = 0; i < ctx->chapter_count; i++) {
+        const chapter_t *chapter = &ctx->chapters[i];
+        fprintf(file, "%s\n    {\"level\": %d, \"page\": %d, \"offset\": %ld, \"title\": ",
+                i > 0 ? "," : "", chapter->level, chapter->page, chapter->offset);
+        write_json_string(file, chapter->title);
+        fputc('}', file);
+    }
+
+    fputs("\n  ],\n  \"tables\": [", file);
+    for (int i = 0; i < ctx->table_ref_count; i++) {
+        const table_ref_t *ref = &ctx->table_refs[i];
+        fprintf(file, "%s\n    {\"page\": %d, \"offset\": %ld, \"name\": ",
+                i > 0 ? "," : "", ref->page, ref->offset);
+        write_json_string(file, ref->name);
+        fputc('}', file);
+    }
+    fputs("\n  ]\n}\n", file);
+
+    fclose(file);
+    return 1;
+}
+
+void free_page_index(stroff_context_t *ctx) {
+    free(ctx->page_offsets);
+    ctx->page_offsets = NULL;
+    ctx->page_offset_count = 0;
+    ctx->page_offset_capacity = 0;
+}
@@ -0,0 +1,136 @@
+#include "stroff.h"
+
+// Mapa de páginas de la última maquetación completa: total de páginas, por cada
+// encabezado su página y su punto de reanudación, y la página de cada .LABEL.
+// Permite vistas previas exactas de un capítulo o rango de páginas sin maquetar
+// el resto del documento.
+#define PAGE_MAP_MAGIC "STROFF-PAGEMAP 1"
+
+int save_page_map(stroff_context_t *ctx, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: No se puede escribir el mapa de páginas '%s'\n", path);
+        return 0;
+    }
+
+    fprintf(file, "%s\n", PAGE_MAP_MAGIC);
+    fprintf(file, "pages %d\n", ctx->total_pages);
+    for (int i = 0; i < ctx->chapter_count; i++) {
+        const chapter_t *chapter = &ctx->chapters[i];
+        fprintf(file, "entry %d %d %d %d %d %s\n", chapter->level, chapter->page, chapter->line,
+                chapter->start_page, chapter->start_line, chapter->title);
+    }
+    for (int i = 0; i < ctx->table_ref_count; i++) {
+        fprintf(file, "table %d %s\n", ctx->table_refs[i].page, ctx->table_refs[i].name);
+    }
+    for (int i = 0; i < ctx->label_size; i++) {
+        const label_t *label = &ctx->labels[i];
+        if (label->id && label->defined) fprintf(file, "label %d %s\n", label->page, label->id);
+    }
+
+    fclose(file);
+    return 1;
+}
+
+// Carga el mapa solo si coincide con la estructura del recorrido previo;
+// un mapa de otra versión del documento se ignora
+int load_page_map(stroff_context_t *ctx, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) return 0;
+
+    chapter_t *loaded = malloc(sizeof(chapter_t) * MAX_CHAPTERS);
+    int table_pages[MAX_TABLES];
+    int chapter_count = 0;
+    int table_count = 0;
+    int total_pages = 0;
+    int valid = 1;
+    // Las líneas "label" se guardan y se aplican solo si se acepta el mapa entero
+    char *labels = NULL;
+    size_t label_length = 0;
+    size_t label_capacity = 0;
+
+    char line[MAX_LINE_LENGTH];
+    if (!fgets(line, sizeof(line), file) || strncmp(line, PAGE_MAP_MAGIC, strlen(PAGE_MAP_MAGIC)) != 0) {
+        valid = 0;
+    }
+
+    while (valid && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+        int consumed = 0;
+
+        if (sscanf(line, "pages %d", &total_pages) == 1) {
+            continue;
+        }
+
+        if (strncmp(line, "entry ", 6) == 0) {
+            chapter_t entry;
+            if (chapter_count >= ctx->chapter_count ||
+                sscanf(line, "entry %d %d %d %d %d %n", &entry.level, &entry.page, &entry.line,
+                       &entry.start_page, &entry.start_line, &consumed) != 5 || consumed == 0) {
+                valid = 0;
+                break;
+            }
+            const chapter_t *outline = &ctx->chapters[chapter_count];
+            if (entry.level != outline->level || strcmp(line + consumed, outline->title) != 0) {
+                valid = 0;
+                break;
+            }
+            loaded[chapter_count++] = entry;
+        } else if (strncmp(line, "table ", 6) == 0) {
+            int page;
+            if (table_count >= ctx->table_ref_count ||
+                sscanf(line, "table %d %n", &page, &consumed) != 1 || consumed == 0 ||
+                strcmp(line + consumed, ctx->table_refs[table_count].name) != 0) {
+                valid = 0;
+                break;
+            }
+            table_pages[table_count++] = page;
+        } else if (strncmp(line, "label ", 6) == 0) {
+            // Las etiquetas no forman parte de la estructura: su página solo es la
+            // primera suposición de las {REF:}, y la maquetación la corrige
+            int page;
+            if (sscanf(line, "label %d %n", &page, &consumed) == 1 && consumed > 0 && line[consumed]) {
+                size_t length = strlen(line + 6) + 1;
+                if (label_length + length > label_capacity) {
+                    size_t capacity = label_capacity ? label_capacity * 2 : 4096;
+                    while (capacity < label_length + length) capacity *= 2;
+                    char *grown = realloc(labels, capacity);
+                    if (!grown) {
+                        valid = 0;
+                        break;
+                    }
+                    labels = grown;
+                    label_capacity = capacity;
+                }
+                memcpy(labels + label_length, line + 6, length);
+                label_length += length;
+            }
+        }
+    }
+    fclose(file);
+
+    if (valid && chapter_count == ctx->chapter_count && table_count == ctx->table_ref_count && total_pages > 0) {
+        for (int i = 0; i < chapter_count; i++) {
+            ctx->chapters[i].page = loaded[i].page;
+            ctx->chapters[i].line = loaded[i].line;
+            ctx->chapters[i].start_page = loaded[i].start_page;
+            ctx->chapters[i].start_line = loaded[i].start_line;
+        }
+        for (int i = 0; i < table_count; i++) {
+            ctx->table_refs[i].page = table_pages[i];
+        }
+        ctx->total_pages = total_pages;
+        for (size_t offset = 0; offset < label_length; offset += strlen(labels + offset) + 1) {
+            int page;
+            int consumed = 0;
+            sscanf(labels + offset, "%d %n", &page, &consumed);
+            set_label_page(ctx, labels + offset + consumed, page);
+        }
+    } else {
+        valid = 0;
+    }
+
+    free(labels);
+    free(loaded);
+    return valid;
+}
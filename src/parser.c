@@ -1,92 +1,5 @@
 #include "stroff.h"
 
-static int is_absolute_path(const char *path) {
-    if (!path || !path[0]) {
-        return 0;
-    }
-
-#ifdef _WIN32
-    if (path[0] == '\\' || path[0] == '/') {
-        return 1;
-    }
-    if (strlen(path) > 1 && path[1] == ':') {
-        return 1;
-    }
-    return 0;
-#else
-    return path[0] == '/';
-#endif
-}
-
-static void join_paths(const char *base, const char *relative, char *out) {
-    if (!base || !base[0]) {
-        strncpy(out, relative, MAX_PATH_LENGTH - 1);
-        out[MAX_PATH_LENGTH - 1] = '\0';
-        return;
-    }
-
-    size_t base_len = strlen(base);
-    int has_separator = base_len > 0 && (base[base_len - 1] == '/' || base[base_len - 1] == '\\');
-    if (has_separator) {
-        snprintf(out, MAX_PATH_LENGTH, "%s%s", base, relative);
-    } else {
-        snprintf(out, MAX_PATH_LENGTH, "%s/%s", base, relative);
-    }
-}
-
-static void get_directory(const char *path, char *dir_out) {
-    if (!path || !path[0]) {
-        dir_out[0] = '\0';
-        return;
-    }
-
-    const char *last_sep = NULL;
-    for (const char *p = path; *p; p++) {
-        if (*p == '/' || *p == '\\') {
-            last_sep = p;
-        }
-    }
-
-    if (!last_sep) {
-        dir_out[0] = '\0';
-        return;
-    }
-
-    size_t dir_len = (size_t)(last_sep - path);
-
-    if (dir_len == 0) {
-        dir_out[0] = *last_sep;
-        dir_out[1] = '\0';
-        return;
-    }
-
-    if (dir_len >= MAX_PATH_LENGTH) {
-        dir_len = MAX_PATH_LENGTH - 1;
-    }
-
-    strncpy(dir_out, path, dir_len);
-    dir_out[dir_len] = '\0';
-}
-
-static void resolve_include_path(stroff_context_t *ctx, const char *filename, char *resolved) {
-    if (is_absolute_path(filename)) {
-        strncpy(resolved, filename, MAX_PATH_LENGTH - 1);
-        resolved[MAX_PATH_LENGTH - 1] = '\0';
-        return;
-    }
-
-    if (ctx->include_depth > 0) {
-        const char *base = ctx->include_stack[ctx->include_depth - 1];
-        if (base[0]) {
-            join_paths(base, filename, resolved);
-            return;
-        }
-    }
-
-    strncpy(resolved, filename, MAX_PATH_LENGTH - 1);
-    resolved[MAX_PATH_LENGTH - 1] = '\0';
-}
-
 void init_context(stroff_context_t *ctx) {
     strcpy(ctx->params.title, "");
     strcpy(ctx->params.author, "");
@@ -103,9 +16,31 @@ void init_context(stroff_context_t *ctx) {
     ctx->params.head_align = ALIGN_LEFT;
     strcpy(ctx->params.footer, "");
     ctx->params.foot_align = ALIGN_LEFT;
+    ctx->params.hyphenate = -1;
+    ctx->hyphen_cache = NULL;
+    ctx->defines = NULL;
+    ctx->define_count = 0;
+    ctx->define_capacity = 0;
+    ctx->macros = NULL;
+    ctx->macro_count = 0;
+    ctx->macro_capacity = 0;
+    ctx->recording_macro = -1;
+    ctx->macro_depth = 0;
+    ctx->cli_defines = NULL;
+    ctx->cli_define_count = 0;
+    reset_conditionals(ctx);
+    compile_template(&ctx->header_template, "");
+    compile_template(&ctx->footer_template, "");
 
     ctx->chapter_count = 0;
+    ctx->chapter_index = 0;
     ctx->table_ref_count = 0;
+    ctx->table_ref_index = 0;
+    ctx->outline_only = 0;
+    ctx->needs_total_pages = 0;
+    ctx->needs_label_pages = 0;
+    ctx->use_fixups = 0;
+    ctx->fixup_count = 0;
     ctx->current_page = 1;
     ctx->total_pages = 1;
     ctx->current_line = 0;
@@ -119,323 +54,735 @@ void init_context(stroff_context_t *ctx) {
     ctx->generate_tot = 0;
     ctx->current_list.type = LIST_NONE;
     ctx->current_list.item_count = 0;
-    ctx->current_table.row_count = 0;
+    memset(&ctx->current_table, 0, sizeof(ctx->current_table));
     ctx->current_paragraph_align = ALIGN_LEFT;
     ctx->first_line_of_paragraph = 0;
+    ctx->page.data = NULL;
+    ctx->page.length = 0;
+    ctx->page.capacity = 0;
+    ctx->page.header_length = 0;
+    ctx->page.has_header = 0;
+    ctx->layout_mode = LAYOUT_FULL;
+    ctx->resume_chapter = -1;
+    ctx->stop_chapter = -1;
+    ctx->stop_after_range = 0;
+    ctx->stop_processing = 0;
+    ctx->heading_start_page = 1;
+    ctx->heading_start_line = 0;
+    ctx->heading_start_offset = -1;
+    ctx->bytes_written = 0;
+    ctx->fixup_pending = 0;
+    ctx->first_output_page = 0;
+    ctx->last_output_page = 0;
     ctx->output = NULL;
+    ctx->writer = NULL;
+    ctx->target_count = 0;
+    memset(ctx->targets, 0, sizeof(ctx->targets));
+    add_render_target(ctx, &text_renderer, NULL);
+    ctx->include_depth = 0;
+    for (int i = 0; i < MAX_INCLUDE_DEPTH; i++) {
+        ctx->include_stack[i][0] = '\0';
+    }
+    ctx->track_dependencies = 0;
+    ctx->dependencies = NULL;
+    ctx->dependency_count = 0;
+    ctx->dependency_capacity = 0;
+    ctx->include_dirs = NULL;
+    ctx->include_dir_count = 0;
+    ctx->include_cache = NULL;
+    ctx->include_cache_size = 0;
+    ctx->include_cache_count = 0;
+    ctx->cache_sources = 0;
+    ctx->sources = NULL;
+    ctx->source_count = 0;
+    ctx->source_capacity = 0;
+    ctx->build_index = 0;
+    ctx->page_offsets = NULL;
+    ctx->page_offset_count = 0;
+    ctx->page_offset_capacity = 0;
+    ctx->labels = NULL;
+    ctx->label_size = 0;
+    ctx->label_count = 0;
+    ctx->index_terms = NULL;
+    ctx->index_term_count = 0;
+    ctx->index_term_capacity = 0;
+    ctx->index_slots = NULL;
+    ctx->index_slot_count = 0;
+    ctx->index_pages = NULL;
+    ctx->index_page_count = 0;
+    ctx->index_page_capacity = 0;
+    ctx->compiled = NULL;
+    ctx->check = NULL;
+    ctx->source_path = NULL;
+    ctx->source_line = 0;
+    update_page_geometry(ctx);
+}
+
+void free_context(stroff_context_t *ctx) {
+    table_free(&ctx->current_table);
+    free_hyphen_cache(ctx);
+    free_macros(ctx);
+    free_dependencies(ctx);
+    free_include_paths(ctx);
+    free_sources(ctx);
+    free_page_index(ctx);
+    free_labels(ctx);
+    free_keyword_index(ctx);
+    free_compiled_document(ctx);
+    for (int i = 0; i < MAX_RENDER_TARGETS; i++) {
+        free(ctx->targets[i].code_buffer);
+        ctx->targets[i].code_buffer = NULL;
+    }
+    free(ctx->page.data);
+    ctx->page.data = NULL;
+    ctx->page.capacity = 0;
+    ctx->page.length = 0;
+}
+
+void begin_pass(stroff_context_t *ctx) {
+    ctx->in_document = 0;
+    ctx->in_code_block = 0;
+    ctx->in_chapters = 0;
+    ctx->generate_toc = 0;
+    ctx->generate_tot = 0;
+    ctx->current_list.type = LIST_NONE;
+    ctx->current_list.item_count = 0;
+    ctx->current_table.row_count = 0;
+    ctx->current_paragraph_align = ALIGN_LEFT;
+    ctx->first_line_of_paragraph = 0;
+    ctx->current_page = 1;
+    ctx->current_line = 0;
+    strcpy(ctx->current_chapter, "");
+    strcpy(ctx->current_subchap, "");
+    strcpy(ctx->current_subsubchap, "");
     ctx->include_depth = 0;
     for (int i = 0; i < MAX_INCLUDE_DEPTH; i++) {
         ctx->include_stack[i][0] = '\0';
     }
+    // Los capítulos y tablas ya conocidos se conservan: el TOC los usa antes de llegar a ellos
+    ctx->chapter_index = 0;
+    ctx->table_ref_index = 0;
+    ctx->fixup_count = 0;
+    ctx->fixup_pending = 0;
+    ctx->page_offset_count = 0;
+    ctx->keep.active = 0;
+    clear_macros(ctx);
+    reset_conditionals(ctx);
+    reset_source_positions(ctx);
+    begin_label_pass(ctx);
+    begin_index_pass(ctx);
+    ctx->page.length = 0;
+    ctx->page.header_length = 0;
+    ctx->page.has_header = 0;
+    ctx->bytes_written = 0;
+    update_page_geometry(ctx);
+    ctx->layout_mode = LAYOUT_FULL;
+    ctx->resume_chapter = -1;
+    ctx->stop_chapter = -1;
+    ctx->stop_after_range = 0;
+    ctx->stop_processing = 0;
+    for (int i = 0; i < ctx->target_count; i++) {
+        ctx->targets[i].paragraph_open = 0;
+        ctx->targets[i].code_open = 0;
+        ctx->targets[i].pending_blank = 0;
+    }
+    // NOTA: NO reinicializar ctx->total_pages - mantiene el valor de la pasada anterior
+}
+
+static void register_chapter(stroff_context_t *ctx, const char *title, int level) {
+    if (ctx->chapter_index >= MAX_CHAPTERS) return;
+
+    chapter_t *chapter = &ctx->chapters[ctx->chapter_index];
+    strncpy(chapter->title, title, MAX_TITLE_LENGTH - 1);
+    chapter->title[MAX_TITLE_LENGTH - 1] = '\0';
+    chapter->level = level;
+    // Sin maquetar no hay posiciones nuevas: se conservan las de la última maquetación
+    if (ctx->layout_mode != LAYOUT_SKIP) {
+        chapter->page = ctx->outline_only ? 0 : ctx->current_page;
+        chapter->line = ctx->outline_only ? 0 : ctx->current_line;
+        chapter->start_page = ctx->heading_start_page;
+        chapter->start_line = ctx->heading_start_line;
+        chapter->start_offset = ctx->outline_only ? -1 : ctx->heading_start_offset;
+        chapter->offset = output_offset(ctx);
+    }
+
+    ctx->chapter_index++;
+    if (ctx->chapter_index > ctx->chapter_count) {
+        ctx->chapter_count = ctx->chapter_index;
+    }
+}
+
+static void register_table_ref(stroff_context_t *ctx, const char *name) {
+    if (ctx->table_ref_index >= MAX_TABLES) return;
+
+    table_ref_t *ref = &ctx->table_refs[ctx->table_ref_index];
+    strncpy(ref->name, name, MAX_TITLE_LENGTH - 1);
+    ref->name[MAX_TITLE_LENGTH - 1] = '\0';
+    if (ctx->layout_mode != LAYOUT_SKIP) {
+        ref->page = ctx->outline_only ? 0 : ctx->current_page;
+        ref->offset = output_offset(ctx);
+    }
+
+    ctx->table_ref_index++;
+    if (ctx->table_ref_index > ctx->table_ref_count) {
+        ctx->table_ref_count = ctx->table_ref_index;
+    }
+}
+
+// Byte de la salida en el que la maquetación reanudada en este encabezado continúa
+// el archivo tal cual. Al principio de página la reanudación vuelve a escribir el
+// header, así que se cuenta desde el inicio de la página; dentro de un .KEEP o con
+// algo más en la página no hay un punto así
+static long heading_output_offset(stroff_context_t *ctx) {
+    if (!ctx->output || ctx->layout_mode != LAYOUT_FULL || ctx->keep.active) return -1;
+    if (ctx->current_line > 0) return ctx->bytes_written + (long)ctx->page.length;
+    return ctx->page.length == ctx->page.header_length ? ctx->bytes_written : -1;
+}
+
+// Punto de control al entrar en un encabezado, antes de cualquier salto de página.
+// Las vistas previas reanudan aquí la maquetación o se detienen; devuelve 0 al detenerse
+static int begin_heading(stroff_context_t *ctx) {
+    if (ctx->chapter_index == ctx->stop_chapter) {
+        finish_page(ctx);
+        ctx->stop_processing = 1;
+        return 0;
+    }
+
+    if (ctx->chapter_index == ctx->resume_chapter && ctx->layout_mode == LAYOUT_SKIP) {
+        const chapter_t *checkpoint = &ctx->chapters[ctx->resume_chapter];
+        ctx->layout_mode = LAYOUT_FULL;
+        ctx->current_page = checkpoint->start_page;
+        ctx->current_line = checkpoint->start_line;
+        ctx->page.length = 0;
+        ctx->page.header_length = 0;
+        if (ctx->current_line == 0) {
+            start_page(ctx);
+        } else {
+            // Página empezada antes del punto de control: solo importa su reserva de header
+            ctx->page.has_header = ctx->header_template.segment_count > 0 && ctx->in_chapters;
+            update_page_geometry(ctx);
+        }
+    }
+
+    ctx->heading_start_page = ctx->current_page;
+    ctx->heading_start_line = ctx->current_line;
+    ctx->heading_start_offset = heading_output_offset(ctx);
+    return 1;
+}
+
+// Recorrido previo: registra capítulos y tablas para que TOC/TOT conozcan su
+// altura antes de maquetar, sin formatear ni escribir nada
+static void collect_outline(stroff_context_t *ctx, const char *line) {
+    if (line[0] != '.') return;
+
+    command_line_t cmd;
+    lex_command(line, &cmd);
+    const char *command = cmd.name;
+
+    if (ctx->check) {
+        check_command(ctx, line, &cmd);
+    }
+
+    int level = 0;
+    if (strcmp(command, "CHAP") == 0) level = 1;
+    else if (strcmp(command, "SUBCHAP") == 0) level = 2;
+    else if (strcmp(command, "SUBSUBCHAP") == 0) level = 3;
+
+    if (level > 0) {
+        const char *title = command_string(&cmd);
+        if (title) {
+            register_chapter(ctx, title, level);
+        }
+    }
+    else if (strncmp(command, "TABLE", 5) == 0) {
+        const command_token_t *name = command_key(&cmd, KEY_NAME);
+        if (name) {
+            register_table_ref(ctx, name->text);
+        }
+        const char *filename = command_string(&cmd);
+        if (ctx->track_dependencies && strcmp(command, "TABLEFILE") == 0 && filename) {
+            char resolved[MAX_PATH_LENGTH];
+            resolve_include_path(ctx, filename, resolved);
+            add_dependency(ctx, resolved);
+        }
+    }
+    else if (strcmp(command, "HEADER") == 0 || strcmp(command, "FOOTER") == 0) {
+        const char *template = command_string(&cmd);
+        if (template && strstr(template, "{PAGES}")) {
+            ctx->needs_total_pages = 1;
+        }
+    }
+    else if (strcmp(command, "LABEL") == 0) {
+        const char *id = command_string(&cmd);
+        if (id) {
+            define_label(ctx, id);
+        }
+    }
+    else if (strcmp(command, "CODE") == 0) {
+        ctx->in_code_block = 1;
+    }
+    else if (strcmp(command, "ECODE") == 0) {
+        ctx->in_code_block = 0;
+    }
+    else if (strcmp(command, "INCLUDE") == 0) {
+        const char *filename = command_string(&cmd);
+        if (filename) {
+            process_file(ctx, filename);
+        }
+    }
 }
 
 void process_file(stroff_context_t *ctx, const char *filename) {
+    // Documento precompilado (--compile): sus registros sustituyen al archivo principal
+    if (ctx->compiled && ctx->include_depth == 0) {
+        if (ctx->outline_only && ctx->track_dependencies) {
+            add_dependency(ctx, filename);
+        }
+        replay_compiled_document(ctx);
+        if (ctx->outline_only && !ctx->stop_processing) {
+            check_conditionals_closed(ctx);
+        }
+        return;
+    }
+
     char resolved_path[MAX_PATH_LENGTH];
     resolve_include_path(ctx, filename, resolved_path);
 
-    FILE *file = fopen(resolved_path, "r");
-    if (!file) {
-        fprintf(stderr, "Error: No se puede abrir el archivo '%s'\n", resolved_path);
-        return;
+    if (!enter_include(ctx, resolved_path)) return;
+
+    if (ctx->outline_only && ctx->track_dependencies) {
+        add_dependency(ctx, resolved_path);
     }
 
-    if (ctx->include_depth >= MAX_INCLUDE_DEPTH) {
-        fprintf(stderr, "Error: Límite de inclusión excedido (%d niveles)\n", MAX_INCLUDE_DEPTH);
-        fclose(file);
-        return;
+    if (ctx->cache_sources) {
+        if (!process_cached_source(ctx, resolved_path)) {
+            report_error(ctx, "No se puede abrir el archivo '%s'", resolved_path);
+        }
+    } else {
+        FILE *file = fopen(resolved_path, "r");
+        if (file) {
+            const char *saved_path = ctx->source_path;
+            int saved_line = ctx->source_line;
+            ctx->source_path = resolved_path;
+            ctx->source_line = 0;
+
+            // Una línea más larga que el buffer llega en varios trozos: todos
+            // cuentan como la misma línea del archivo
+            char line[MAX_LINE_LENGTH];
+            int continued = 0;
+            while (!ctx->stop_processing && fgets(line, sizeof(line), file)) {
+                size_t length = strcspn(line, "\n");
+                int complete = line[length] == '\n' || feof(file);
+                if (!continued) {
+                    ctx->source_line++;
+                    if (!complete && ctx->check) {
+                        report_error(ctx, "Línea de más de %d bytes: se procesa partida en varias",
+                                     MAX_LINE_LENGTH - 1);
+                    }
+                }
+                continued = !complete;
+                line[length] = '\0';
+                process_line(ctx, line);
+            }
+            fclose(file);
+
+            ctx->source_path = saved_path;
+            ctx->source_line = saved_line;
+        } else {
+            report_error(ctx, "No se puede abrir el archivo '%s'", resolved_path);
+        }
     }
 
-    char current_dir[MAX_PATH_LENGTH];
-    get_directory(resolved_path, current_dir);
-    strncpy(ctx->include_stack[ctx->include_depth], current_dir, MAX_PATH_LENGTH - 1);
-    ctx->include_stack[ctx->include_depth][MAX_PATH_LENGTH - 1] = '\0';
-    ctx->include_depth++;
+    leave_include(ctx);
 
-    char line[MAX_LINE_LENGTH];
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\n")] = '\0';
-        process_line(ctx, line);
+    // El recorrido previo lee siempre el documento entero: avisa una sola vez
+    if (ctx->include_depth == 0 && ctx->outline_only && !ctx->stop_processing) {
+        check_conditionals_closed(ctx);
     }
+}
 
-    ctx->include_depth--;
-    ctx->include_stack[ctx->include_depth][0] = '\0';
-    fclose(file);
+// Pasada de conteo: las páginas se maquetan pero no se escriben. Cada {REF:}
+// muestra la página de la pasada anterior y su texto puede mover la maquetación,
+// así que se repite mientras alguna etiqueta cambie de página
+void count_pages(stroff_context_t *ctx, const char *input_path) {
+    for (int pass = 0; pass < MAX_COUNTING_PASSES; pass++) {
+        ctx->output = NULL;
+        begin_pass(ctx);
+        process_file(ctx, input_path);
+        flush_output(ctx);
+        ctx->total_pages = ctx->current_page;
+        if (!labels_changed(ctx)) break;
+    }
 }
 
 void process_line(stroff_context_t *ctx, const char *line) {
+    if (ctx->cond_skip_from) {
+        skip_conditional_line(ctx, line);
+        return;
+    }
+    if (record_macro_line(ctx, line)) return;
+
+    // Los bloques de código son literales: sin expansión de variables
+    if (ctx->in_code_block) {
+        process_expanded_line(ctx, line);
+        return;
+    }
+
+    char expanded[MAX_LINE_LENGTH];
+    process_expanded_line(ctx, expand_variables(ctx, line, expanded, sizeof(expanded)));
+}
+
+// ".ECODE" con espacios opcionales alrededor, sin copiar ni recortar la línea
+static int is_code_block_end(const char *line) {
+    while (isspace((unsigned char)*line)) line++;
+    if (strncmp(line, ".ECODE", 6) != 0) return 0;
+    for (line += 6; *line; line++) {
+        if (!isspace((unsigned char)*line)) return 0;
+    }
+    return 1;
+}
+
+// Línea con las variables ya sustituidas (o procedente del cuerpo de una macro)
+void process_expanded_line(stroff_context_t *ctx, const char *line) {
+    // Cuerpos de macro con .IF: sus líneas también pueden caer en un bloque descartado
+    if (ctx->cond_skip_from) {
+        skip_conditional_line(ctx, line);
+        return;
+    }
+
+    // Dentro de .CODE solo se busca el terminador: el resto va tal cual al renderer
+    if (ctx->in_code_block && !is_code_block_end(line)) {
+        if (!ctx->outline_only) {
+            process_text(ctx, line);
+        }
+        return;
+    }
+
     char working[MAX_LINE_LENGTH];
     strncpy(working, line, MAX_LINE_LENGTH - 1);
     working[MAX_LINE_LENGTH - 1] = '\0';
 
     char *trimmed = trim_whitespace(working);
 
-    if (ctx->in_code_block && strcmp(trimmed, ".ECODE") != 0) {
-        process_text(ctx, line);
+    if (strlen(trimmed) == 0) {
         return;
     }
 
-    if (strlen(trimmed) == 0) {
+    if (trimmed[0] == '#') {
         return;
     }
 
-    if (trimmed[0] == '#') {
+    process_trimmed_line(ctx, trimmed);
+}
+
+// Línea recortada, no vacía y que no es un comentario
+void process_trimmed_line(stroff_context_t *ctx, const char *trimmed) {
+    if (trimmed[0] == '.' && (handle_conditional(ctx, trimmed) || handle_macro_command(ctx, trimmed))) {
         return;
     }
 
-    if (trimmed[0] == '.') {
+    if (ctx->outline_only) {
+        collect_outline(ctx, trimmed);
+    } else if (trimmed[0] == '.') {
         process_command(ctx, trimmed);
     } else {
         process_text(ctx, trimmed);
     }
 }
 
+// Parámetros comunes de .TABLE y .TABLEFILE: WIDTHS, ALIGNS y NAME. Se leen todos
+// los valores dados: .TABLEFILE sin COLS conoce las columnas al leer el archivo
+static void parse_table_options(stroff_context_t *ctx, table_t *table, const command_line_t *cmd) {
+    // Sin WIDTHS= o con WIDTHS=AUTO los anchos salen de las celdas al cerrar la tabla
+    const command_token_t *widths = command_key(cmd, KEY_WIDTHS);
+    table->auto_widths = !widths || strcmp(widths->text, "AUTO") == 0;
+    if (!table->auto_widths) {
+        const char *p = widths->text;
+        for (int col = 0; col < MAX_TABLE_COLS && *p; col++) {
+            table->widths[col] = atoi(p);
+            p = strchr(p, ',');
+            if (!p) break;
+            p++;
+        }
+    }
+
+    const command_token_t *aligns = command_key(cmd, KEY_ALIGNS);
+    if (aligns) {
+        const char *p = aligns->text;
+        for (int i = 0; i < MAX_TABLE_COLS; i++) {
+            if (p[i*2] == 'L') table->aligns[i] = ALIGN_LEFT;
+            else if (p[i*2] == 'C') table->aligns[i] = ALIGN_CENTER;
+            else if (p[i*2] == 'R') table->aligns[i] = ALIGN_RIGHT;
+            if (p[i*2] == '\0' || p[i*2 + 1] != ',') break;
+        }
+    }
+
+    const command_token_t *name = command_key(cmd, KEY_NAME);
+    if (name) {
+        strncpy(table->name, name->text, MAX_TITLE_LENGTH - 1);
+        register_table_ref(ctx, name->text);
+    }
+}
+
+// Celdas entre comillas de .TH (fila -1) o .TR; las columnas sin valor quedan vacías
+static void parse_table_cells(table_t *table, const char *line, int row) {
+    const char *quote_start = strchr(line, '"');
+    if (!quote_start) return;
+
+    quote_start++;
+    int col = 0;
+    const char *current = quote_start;
+
+    while (*current && col < table->cols) {
+        const char *quote_end = strchr(current, '"');
+        if (!quote_end) break;
+
+        table_set_cell(table, row, col, current, (int)(quote_end - current));
+
+        col++;
+        current = quote_end + 1;
+
+        while (*current && (*current == ' ' || *current == '|')) current++;
+        if (*current == '"') current++;
+    }
+}
+
 void process_command(stroff_context_t *ctx, const char *line) {
-    char command[MAX_COMMAND_LENGTH];
-    sscanf(line, ".%s", command);
+    command_line_t cmd;
+    lex_command(line, &cmd);
+    const char *command = cmd.name;
 
     if (strcmp(command, "TITLE") == 0) {
-        char *title = extract_string_param(line, "TITLE");
+        const char *title = command_string(&cmd);
         if (title) {
             strncpy(ctx->params.title, title, MAX_TITLE_LENGTH - 1);
-            free(title);
         }
     }
     else if (strcmp(command, "AUTH") == 0) {
-        char *auth = extract_string_param(line, "AUTH");
+        const char *auth = command_string(&cmd);
         if (auth) {
             strncpy(ctx->params.author, auth, MAX_TITLE_LENGTH - 1);
-            free(auth);
         }
     }
     else if (strcmp(command, "DATE") == 0) {
-        char *date = extract_string_param(line, "DATE");
+        const char *date = command_string(&cmd);
         if (date) {
             strncpy(ctx->params.date, date, MAX_TITLE_LENGTH - 1);
-            free(date);
         }
     }
     else if (strcmp(command, "PAGEWIDTH") == 0) {
-        ctx->params.page_width = extract_int_param(line, "PAGEWIDTH");
+        ctx->params.page_width = command_int(&cmd);
+        update_page_geometry(ctx);
     }
     else if (strcmp(command, "PAGEHEIGHT") == 0) {
-        ctx->params.page_height = extract_int_param(line, "PAGEHEIGHT");
+        ctx->params.page_height = command_int(&cmd);
+        update_page_geometry(ctx);
     }
     else if (strcmp(command, "LMARGIN") == 0) {
-        ctx->params.left_margin = extract_int_param(line, "LMARGIN");
+        ctx->params.left_margin = command_int(&cmd);
+        update_page_geometry(ctx);
     }
     else if (strcmp(command, "RMARGIN") == 0) {
-        ctx->params.right_margin = extract_int_param(line, "RMARGIN");
+        ctx->params.right_margin = command_int(&cmd);
+        update_page_geometry(ctx);
     }
     else if (strcmp(command, "INDENT") == 0) {
-        ctx->params.indent = extract_int_param(line, "INDENT");
+        ctx->params.indent = command_int(&cmd);
     }
     else if (strcmp(command, "TABSIZE") == 0) {
-        ctx->params.tab_size = extract_int_param(line, "TABSIZE");
+        ctx->params.tab_size = command_int(&cmd);
     }
     else if (strcmp(command, "JUSTIFY") == 0) {
-        const char *align_start = strstr(line, "JUSTIFY") + 7;
-        while (*align_start && isspace(*align_start)) align_start++;
-        ctx->params.justify = parse_align(align_start);
+        const char *align_start = command_word(&cmd);
+        ctx->params.justify = parse_align(align_start ? align_start : "");
+    }
+    else if (strcmp(command, "HYPHENATE") == 0) {
+        // .HYPHENATE es|en|OFF
+        const char *arg = command_word(&cmd);
+        char language[16];
+        int len = 0;
+        while (arg && arg[len] && !isspace((unsigned char)arg[len]) && len < (int)sizeof(language) - 1) {
+            language[len] = (char)tolower((unsigned char)arg[len]);
+            len++;
+        }
+        language[len] = '\0';
+
+        if (len == 0 || strcmp(language, "off") == 0) {
+            ctx->params.hyphenate = -1;
+        } else {
+            int index = find_hyphen_language(language);
+            if (index < 0) {
+                report_error(ctx, "Idioma de división silábica desconocido '%s'", language);
+            } else {
+                ctx->params.hyphenate = index;
+            }
+        }
     }
     else if (strcmp(command, "LINESPACE") == 0) {
-        ctx->params.line_space = extract_int_param(line, "LINESPACE");
+        ctx->params.line_space = command_int(&cmd);
     }
     else if (strcmp(command, "HEADER") == 0) {
-        char *header = extract_string_param(line, "HEADER");
+        const char *header = command_string(&cmd);
         if (header) {
             strncpy(ctx->params.header, header, MAX_TITLE_LENGTH - 1);
-            free(header);
+            compile_template(&ctx->header_template, ctx->params.header);
+            update_page_geometry(ctx);
         }
     }
     else if (strcmp(command, "HEADALIGN") == 0) {
-        const char *align_start = strstr(line, "HEADALIGN") + 9;
-        while (*align_start && isspace(*align_start)) align_start++;
-        ctx->params.head_align = parse_align(align_start);
+        const char *align_start = command_word(&cmd);
+        ctx->params.head_align = parse_align(align_start ? align_start : "");
     }
     else if (strcmp(command, "FOOTER") == 0) {
-        char *footer = extract_string_param(line, "FOOTER");
+        const char *footer = command_string(&cmd);
         if (footer) {
             strncpy(ctx->params.footer, footer, MAX_TITLE_LENGTH - 1);
-            free(footer);
+            compile_template(&ctx->footer_template, ctx->params.footer);
+            update_page_geometry(ctx);
         }
     }
     else if (strcmp(command, "FOOTALIGN") == 0) {
-        const char *align_start = strstr(line, "FOOTALIGN") + 9;
-        while (*align_start && isspace(*align_start)) align_start++;
-        ctx->params.foot_align = parse_align(align_start);
+        const char *align_start = command_word(&cmd);
+        ctx->params.foot_align = parse_align(align_start ? align_start : "");
     }
     else if (strcmp(command, "DOCUMENT") == 0) {
         ctx->in_document = 1;
-        ctx->current_line = 0;
-
-        // Header solo en capítulos, no en página de título
-        if (strlen(ctx->params.header) > 0 && ctx->in_chapters) {
-            output_header(ctx);
-            fprintf(ctx->output, "\n");
-            ctx->current_line++;
-        }
-
-        fprintf(ctx->output, "\n");
-        ctx->current_line++;
-        if (strlen(ctx->params.title) > 0) {
-            output_text(ctx, ctx->params.title, ALIGN_CENTER);
-            check_page_break(ctx, 1);
-            fprintf(ctx->output, "\n");
-            ctx->current_line++;
-        }
-        if (strlen(ctx->params.author) > 0) {
-            output_text(ctx, ctx->params.author, ALIGN_CENTER);
-            check_page_break(ctx, 1);
-            fprintf(ctx->output, "\n");
-            ctx->current_line++;
-        }
-        if (strlen(ctx->params.date) > 0) {
-            output_text(ctx, ctx->params.date, ALIGN_CENTER);
-            check_page_break(ctx, 1);
-            fprintf(ctx->output, "\n");
-            ctx->current_line++;
-        }
-        check_page_break(ctx, 1);
-        fprintf(ctx->output, "\n");
-        ctx->current_line++;
+        render_begin_document(ctx);
     }
     else if (strcmp(command, "EDOC") == 0) {
-        // Procesar la última página antes de cerrar documento
-        if (strlen(ctx->params.footer) > 0) {
-            // Llenar líneas hasta el final de la página
-            while (ctx->current_line < ctx->params.page_height - 3) {
-                fprintf(ctx->output, "\n");
-                ctx->current_line++;
-            }
-            output_footer(ctx);
-        } else {
-            // Sin footer, llenar hasta el final completo
-            while (ctx->current_line < ctx->params.page_height - 1) {
-                fprintf(ctx->output, "\n");
-                ctx->current_line++;
-            }
-        }
+        render_end_document(ctx);
         ctx->in_document = 0;
     }
     else if (strcmp(command, "MAKETOC") == 0) {
-        output_toc(ctx);
+        render_toc(ctx);
     }
     else if (strcmp(command, "MAKETOT") == 0) {
-        output_tot(ctx);
+        render_tot(ctx);
+    }
+    else if (strcmp(command, "INDEX") == 0) {
+        const char *term = command_string(&cmd);
+        if (term) {
+            add_index_entry(ctx, term);
+        }
+    }
+    else if (strcmp(command, "MAKEINDEX") == 0) {
+        render_index(ctx);
     }
     else if (strcmp(command, "PAGEBREAK") == 0) {
-        new_page(ctx);
+        render_page_break(ctx);
+    }
+    else if (strcmp(command, "KEEP") == 0) {
+        // Solo afecta a la paginación del texto: HTML y Markdown no tienen páginas
+        begin_keep(ctx);
+    }
+    else if (strcmp(command, "EKEEP") == 0) {
+        end_keep(ctx);
+    }
+    else if (strcmp(command, "LABEL") == 0) {
+        const char *id = command_string(&cmd);
+        if (id) {
+            define_label(ctx, id);
+        }
     }
     else if (strcmp(command, "CHAP") == 0) {
-        char *title = extract_string_param(line, "CHAP");
-        if (title && ctx->chapter_count < MAX_CHAPTERS) {
+        const char *title = command_string(&cmd);
+        if (title) {
+            if (!begin_heading(ctx)) {
+                return;
+            }
             ctx->in_chapters = 1;
             check_page_break(ctx, 4);
 
-            strncpy(ctx->chapters[ctx->chapter_count].title, title, MAX_TITLE_LENGTH - 1);
-            ctx->chapters[ctx->chapter_count].level = 1;
-            ctx->chapters[ctx->chapter_count].page = ctx->current_page;
+            register_chapter(ctx, title, 1);
             strncpy(ctx->current_chapter, title, MAX_TITLE_LENGTH - 1);
-            ctx->chapter_count++;
 
-            fprintf(ctx->output, "\n%s\n", title);
-            ctx->current_line += 2;
-            for (int i = 0; i < strlen(title); i++) {
-                fprintf(ctx->output, "=");
-            }
-            fprintf(ctx->output, "\n\n");
-            ctx->current_line += 2;
-            free(title);
+            render_heading(ctx, title, 1, ctx->chapter_index - 1);
         }
     }
     else if (strcmp(command, "SUBCHAP") == 0) {
-        char *title = extract_string_param(line, "SUBCHAP");
-        if (title && ctx->chapter_count < MAX_CHAPTERS) {
+        const char *title = command_string(&cmd);
+        if (title) {
+            if (!begin_heading(ctx)) {
+                return;
+            }
             check_page_break(ctx, 4);
 
-            strncpy(ctx->chapters[ctx->chapter_count].title, title, MAX_TITLE_LENGTH - 1);
-            ctx->chapters[ctx->chapter_count].level = 2;
-            ctx->chapters[ctx->chapter_count].page = ctx->current_page;
+            register_chapter(ctx, title, 2);
             strncpy(ctx->current_subchap, title, MAX_TITLE_LENGTH - 1);
-            ctx->chapter_count++;
 
-            fprintf(ctx->output, "\n%s\n", title);
-            ctx->current_line += 2;
-            for (int i = 0; i < strlen(title); i++) {
-                fprintf(ctx->output, "-");
-            }
-            fprintf(ctx->output, "\n\n");
-            ctx->current_line += 2;
-            free(title);
+            render_heading(ctx, title, 2, ctx->chapter_index - 1);
         }
     }
     else if (strcmp(command, "SUBSUBCHAP") == 0) {
-        char *title = extract_string_param(line, "SUBSUBCHAP");
-        if (title && ctx->chapter_count < MAX_CHAPTERS) {
+        const char *title = command_string(&cmd);
+        if (title) {
+            if (!begin_heading(ctx)) {
+                return;
+            }
             check_page_break(ctx, 3);
 
-            strncpy(ctx->chapters[ctx->chapter_count].title, title, MAX_TITLE_LENGTH - 1);
-            ctx->chapters[ctx->chapter_count].level = 3;
-            ctx->chapters[ctx->chapter_count].page = ctx->current_page;
+            register_chapter(ctx, title, 3);
             strncpy(ctx->current_subsubchap, title, MAX_TITLE_LENGTH - 1);
-            ctx->chapter_count++;
 
-            fprintf(ctx->output, "\n%s\n\n", title);
-            ctx->current_line += 3;
-            free(title);
+            render_heading(ctx, title, 3, ctx->chapter_index - 1);
         }
     }
     else if (strcmp(command, "P") == 0) {
-        check_page_break(ctx, 1);
-        fprintf(ctx->output, "\n");
-        ctx->current_line++;
         ctx->current_paragraph_align = ctx->params.justify;
         ctx->first_line_of_paragraph = 1;
 
-        if (strstr(line, "LEFT")) {
+        // Solo una palabra suelta cambia la alineación, no el texto entre comillas
+        const char *align = command_word(&cmd);
+        if (!align) {
+            // Alineación por defecto del documento
+        } else if (strcmp(align, "LEFT") == 0) {
             ctx->current_paragraph_align = ALIGN_LEFT;
-        } else if (strstr(line, "RIGHT")) {
+        } else if (strcmp(align, "RIGHT") == 0) {
             ctx->current_paragraph_align = ALIGN_RIGHT;
-        } else if (strstr(line, "CENTER")) {
+        } else if (strcmp(align, "CENTER") == 0) {
             ctx->current_paragraph_align = ALIGN_CENTER;
-        } else if (strstr(line, "FULL")) {
+        } else if (strcmp(align, "FULL") == 0) {
             ctx->current_paragraph_align = ALIGN_FULL;
         }
+        render_paragraph(ctx, ctx->current_paragraph_align);
     }
     else if (strcmp(command, "BREAK") == 0) {
-        check_page_break(ctx, 1);
-        fprintf(ctx->output, "\n");
-        ctx->current_line++;
+        render_line_break(ctx);
     }
     else if (strcmp(command, "CODE") == 0) {
         ctx->in_code_block = 1;
-        fprintf(ctx->output, "\n");
+        render_code_begin(ctx);
     }
     else if (strcmp(command, "ECODE") == 0) {
         ctx->in_code_block = 0;
-        fprintf(ctx->output, "\n");
+        render_code_end(ctx);
     }
     else if (strcmp(command, "LIST") == 0) {
-        if (strstr(line, "BULLET")) {
+        // TYPE=BULLET|NUMBER|RNUMBER; también se acepta el tipo como palabra suelta
+        const command_token_t *type_key = command_key(&cmd, KEY_TYPE);
+        const char *type = type_key ? type_key->text : command_word(&cmd);
+        if (!type) {
+            // Sin tipo: se mantiene el de la lista anterior
+        } else if (strcmp(type, "BULLET") == 0) {
             ctx->current_list.type = LIST_BULLET;
             ctx->current_list.bullet_char = '*';
-        } else if (strstr(line, "RNUMBER")) {
+        } else if (strcmp(type, "RNUMBER") == 0) {
             ctx->current_list.type = LIST_RNUMBER;
-        } else if (strstr(line, "NUMBER")) {
+        } else if (strcmp(type, "NUMBER") == 0) {
             ctx->current_list.type = LIST_NUMBER;
         }
         ctx->current_list.item_count = 0;
         ctx->current_list.indent = ctx->params.indent;
-        fprintf(ctx->output, "\n");
+        render_list_begin(ctx, ctx->current_list.type);
     }
     else if (strcmp(command, "BULLET") == 0) {
-        const char *bullet_pos = strchr(line, '"');
-        if (bullet_pos) {
-            ctx->current_list.bullet_char = bullet_pos[1];
+        const char *bullet = command_string(&cmd);
+        if (bullet && bullet[0]) {
+            ctx->current_list.bullet_char = bullet[0];
         }
     }
     else if (strcmp(command, "ITEM") == 0) {
-        char *item = extract_string_param(line, "ITEM");
+        const char *item = command_string(&cmd);
         if (item && ctx->current_list.item_count < MAX_LIST_ITEMS) {
             // Crear el prefijo del item (bullet/número)
             char prefix[32] = "";
@@ -460,256 +807,67 @@ void process_command(stroff_context_t *ctx, const char *line) {
             }
 
             // Usar la función especializada para items de lista
-            output_list_item(ctx, prefix, item);
+            render_list_item(ctx, prefix, item);
 
             ctx->current_list.item_count++;
-            free(item);
         }
     }
     else if (strcmp(command, "ELIST") == 0) {
+        render_list_end(ctx);
         ctx->current_list.type = LIST_NONE;
         ctx->current_list.item_count = 0;
-        fprintf(ctx->output, "\n");
     }
-    else if (strncmp(command, "TABLE", 5) == 0) {
-        ctx->current_table.cols = extract_int_param(line, "COLS");
-        ctx->current_table.row_count = 0;
-
-        // Inicializar headers como cadenas vacías y TLINE tracking
-        for (int i = 0; i < ctx->current_table.cols; i++) {
-            ctx->current_table.headers[i][0] = '\0';
-        }
-        ctx->current_table.tline_count = 0;
-
-        const char *widths_pos = strstr(line, "WIDTHS=");
-        if (widths_pos) {
-            widths_pos += 7;
-            char *widths_str = malloc(strlen(widths_pos) + 1);
-            strcpy(widths_str, widths_pos);
-            char *end = strchr(widths_str, ' ');
-            if (end) *end = '\0';
-
-            char *token = strtok(widths_str, ",");
-            int col = 0;
-            while (token && col < ctx->current_table.cols) {
-                ctx->current_table.widths[col] = atoi(token);
-                col++;
-                token = strtok(NULL, ",");
-            }
-            free(widths_str);
-        }
-
-        const char *aligns_pos = strstr(line, "ALIGNS=");
-        if (aligns_pos) {
-            aligns_pos += 7;
-            for (int i = 0; i < ctx->current_table.cols && i < 20; i++) {
-                if (aligns_pos[i*2] == 'L') ctx->current_table.aligns[i] = ALIGN_LEFT;
-                else if (aligns_pos[i*2] == 'C') ctx->current_table.aligns[i] = ALIGN_CENTER;
-                else if (aligns_pos[i*2] == 'R') ctx->current_table.aligns[i] = ALIGN_RIGHT;
+    else if (strcmp(command, "TABLEFILE") == 0) {
+        const char *filename = command_string(&cmd);
+        if (filename) {
+            table_t *table = &ctx->current_table;
+            table_reset(table, command_key_int(&cmd, KEY_COLS));
+            parse_table_options(ctx, table, &cmd);
+
+            // Separador: SEP=TAB|;|, o, por defecto, tabulador en .tsv y coma en el resto
+            const char *ext = strrchr(filename, '.');
+            char delimiter = ext && (strcmp(ext, ".tsv") == 0 || strcmp(ext, ".tab") == 0) ? '\t' : ',';
+            const command_token_t *sep = command_key(&cmd, KEY_SEP);
+            if (sep && sep->length > 0) {
+                delimiter = strcmp(sep->text, "TAB") == 0 ? '\t' : sep->text[0];
             }
-        }
 
-        char *name = extract_string_param(line, "NAME");
-        if (name) {
-            strncpy(ctx->current_table.name, name, MAX_TITLE_LENGTH - 1);
-            if (ctx->table_ref_count < MAX_TABLES) {
-                strncpy(ctx->table_refs[ctx->table_ref_count].name, name, MAX_TITLE_LENGTH - 1);
-                ctx->table_refs[ctx->table_ref_count].page = ctx->current_page;
-                ctx->table_ref_count++;
+            // En LAYOUT_SKIP no se maqueta nada: no hace falta leer el archivo
+            if (ctx->layout_mode != LAYOUT_SKIP) {
+                char resolved[MAX_PATH_LENGTH];
+                resolve_include_path(ctx, filename, resolved);
+                import_table_file(ctx, resolved, delimiter, command_key_int(&cmd, KEY_HEADER) > 0);
             }
-            free(name);
         }
+    }
+    else if (strncmp(command, "TABLE", 5) == 0) {
+        table_t *table = &ctx->current_table;
+        table_reset(table, command_key_int(&cmd, KEY_COLS));
 
-        fprintf(ctx->output, "\n");
+        parse_table_options(ctx, table, &cmd);
     }
     else if (strcmp(command, "TH") == 0) {
-        const char *quote_start = strchr(line, '"');
-        if (quote_start) {
-            quote_start++;
-            int col = 0;
-            const char *current = quote_start;
-
-            while (*current && col < ctx->current_table.cols) {
-                const char *quote_end = strchr(current, '"');
-                if (!quote_end) break;
-
-                int len = quote_end - current;
-                if (len < MAX_TITLE_LENGTH - 1) {
-                    strncpy(ctx->current_table.headers[col], current, len);
-                    ctx->current_table.headers[col][len] = '\0';
-                }
-
-                col++;
-                current = quote_end + 1;
-
-                while (*current && (*current == ' ' || *current == '|')) current++;
-                if (*current == '"') current++;
-            }
-        }
+        parse_table_cells(&ctx->current_table, line, -1);
     }
     else if (strcmp(command, "TLINE") == 0) {
-        // Almacenar información de TLINE para renderizar en ETABLE
-        if (ctx->current_table.tline_count < MAX_TABLE_ROWS) {
-            ctx->current_table.tline_after_row[ctx->current_table.tline_count] = ctx->current_table.row_count - 1;
-            ctx->current_table.tline_count++;
-        }
+        // Se renderiza en ETABLE, tras la última fila leída
+        table_add_rule(&ctx->current_table);
     }
     else if (strcmp(command, "TR") == 0) {
-        if (ctx->current_table.row_count < MAX_TABLE_ROWS) {
-            const char *quote_start = strchr(line, '"');
-            if (quote_start) {
-                quote_start++;
-                int col = 0;
-                const char *current = quote_start;
-
-                while (*current && col < ctx->current_table.cols) {
-                    const char *quote_end = strchr(current, '"');
-                    if (!quote_end) break;
-
-                    int len = quote_end - current;
-                    if (len < MAX_TITLE_LENGTH - 1) {
-                        strncpy(ctx->current_table.data[ctx->current_table.row_count][col], current, len);
-                        ctx->current_table.data[ctx->current_table.row_count][col][len] = '\0';
-                    }
-
-                    col++;
-                    current = quote_end + 1;
-
-                    while (*current && (*current == ' ' || *current == '|')) current++;
-                    if (*current == '"') current++;
-                }
-            }
-            ctx->current_table.row_count++;
-        }
+        int row = table_add_row(&ctx->current_table);
+        parse_table_cells(&ctx->current_table, line, row);
     }
     else if (strcmp(command, "ETABLE") == 0) {
-        // Verificar si hay headers definidos
-        int has_headers = 0;
-        for (int col = 0; col < ctx->current_table.cols; col++) {
-            if (strlen(ctx->current_table.headers[col]) > 0) {
-                has_headers = 1;
-                break;
-            }
+        if (ctx->current_table.auto_widths) {
+            fit_table_widths(ctx, &ctx->current_table);
         }
-
-        // Renderizar headers si existen
-        if (has_headers) {
-            for (int i = 0; i < ctx->params.left_margin; i++) {
-                fprintf(ctx->output, " ");
-            }
-
-            for (int col = 0; col < ctx->current_table.cols; col++) {
-                int width = ctx->current_table.widths[col];
-                char *header = ctx->current_table.headers[col];
-
-                if (ctx->current_table.aligns[col] == ALIGN_CENTER && width > strlen(header)) {
-                    int padding = (width - strlen(header)) / 2;
-                    for (int i = 0; i < padding; i++) fprintf(ctx->output, " ");
-                    fprintf(ctx->output, "%s", header);
-                    int remaining = width - strlen(header) - padding;
-                    for (int i = 0; i < remaining && i >= 0; i++) fprintf(ctx->output, " ");
-                } else if (ctx->current_table.aligns[col] == ALIGN_RIGHT && width > strlen(header)) {
-                    int spaces = width - strlen(header);
-                    for (int i = 0; i < spaces && i >= 0; i++) fprintf(ctx->output, " ");
-                    fprintf(ctx->output, "%s", header);
-                } else {
-                    fprintf(ctx->output, "%s", header);
-                    for (int i = strlen(header); i < width; i++) fprintf(ctx->output, " ");
-                }
-
-                // Espaciado entre columnas (sin marcos verticales)
-                if (col < ctx->current_table.cols - 1) {
-                    fprintf(ctx->output, "  ");
-                }
-            }
-            fprintf(ctx->output, "\n");
-
-            // Verificar si hay TLINE después de headers (row_index -1)
-            for (int i = 0; i < ctx->current_table.tline_count; i++) {
-                if (ctx->current_table.tline_after_row[i] == -1) {
-                    // Renderizar TLINE
-                    for (int j = 0; j < ctx->params.left_margin; j++) {
-                        fprintf(ctx->output, " ");
-                    }
-                    int total_width = 0;
-                    for (int j = 0; j < ctx->current_table.cols; j++) {
-                        total_width += ctx->current_table.widths[j];
-                    }
-                    if (ctx->current_table.cols > 1) {
-                        total_width += (ctx->current_table.cols - 1) * 2;
-                    }
-                    for (int j = 0; j < total_width; j++) {
-                        fprintf(ctx->output, "-");
-                    }
-                    fprintf(ctx->output, "\n");
-                    break;
-                }
-            }
-        }
-
-        for (int row = 0; row < ctx->current_table.row_count; row++) {
-            for (int i = 0; i < ctx->params.left_margin; i++) {
-                fprintf(ctx->output, " ");
-            }
-
-            for (int col = 0; col < ctx->current_table.cols; col++) {
-                int width = ctx->current_table.widths[col];
-                char *data = ctx->current_table.data[row][col];
-
-                if (ctx->current_table.aligns[col] == ALIGN_CENTER && width > strlen(data)) {
-                    int padding = (width - strlen(data)) / 2;
-                    for (int i = 0; i < padding; i++) fprintf(ctx->output, " ");
-                    fprintf(ctx->output, "%s", data);
-                    int remaining = width - strlen(data) - padding;
-                    for (int i = 0; i < remaining && i >= 0; i++) fprintf(ctx->output, " ");
-                } else if (ctx->current_table.aligns[col] == ALIGN_RIGHT && width > strlen(data)) {
-                    int spaces = width - strlen(data);
-                    for (int i = 0; i < spaces && i >= 0; i++) fprintf(ctx->output, " ");
-                    fprintf(ctx->output, "%s", data);
-                } else {
-                    fprintf(ctx->output, "%s", data);
-                    for (int i = strlen(data); i < width; i++) fprintf(ctx->output, " ");
-                }
-
-                // Espaciado entre columnas (sin marcos verticales)
-                if (col < ctx->current_table.cols - 1) {
-                    fprintf(ctx->output, "  ");
-                }
-            }
-            fprintf(ctx->output, "\n");
-
-            // Verificar si hay TLINE después de esta fila
-            for (int i = 0; i < ctx->current_table.tline_count; i++) {
-                if (ctx->current_table.tline_after_row[i] == row) {
-                    // Renderizar TLINE
-                    for (int j = 0; j < ctx->params.left_margin; j++) {
-                        fprintf(ctx->output, " ");
-                    }
-                    int total_width = 0;
-                    for (int j = 0; j < ctx->current_table.cols; j++) {
-                        total_width += ctx->current_table.widths[j];
-                    }
-                    if (ctx->current_table.cols > 1) {
-                        total_width += (ctx->current_table.cols - 1) * 2;
-                    }
-                    for (int j = 0; j < total_width; j++) {
-                        fprintf(ctx->output, "-");
-                    }
-                    fprintf(ctx->output, "\n");
-                    break;
-                }
-            }
-        }
-
-        fprintf(ctx->output, "\n");
-        ctx->current_table.row_count = 0;
-        ctx->current_table.tline_count = 0;
+        render_table(ctx, &ctx->current_table);
+        table_reset(&ctx->current_table, 0);
     }
     else if (strcmp(command, "INCLUDE") == 0) {
-        char *filename = extract_string_param(line, "INCLUDE");
+        const char *filename = command_string(&cmd);
         if (filename) {
             process_file(ctx, filename);
-            free(filename);
         }
     }
 }
@@ -718,11 +876,8 @@ void process_text(stroff_context_t *ctx, const char *text) {
     if (!ctx->in_document) return;
 
     if (ctx->in_code_block) {
-        for (int i = 0; i < ctx->params.left_margin; i++) {
-            fprintf(ctx->output, " ");
-        }
-        fprintf(ctx->output, "%s\n", text);
+        render_code_line(ctx, text);
     } else {
-        output_text(ctx, text, ctx->current_paragraph_align);
+        render_text(ctx, text, ctx->current_paragraph_align);
     }
 }
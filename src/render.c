@@ -0,0 +1,190 @@
+#include "stroff.h"
+
+// Reparto de eventos del parser entre los backends activos, en orden de registro
+
+int add_render_target(stroff_context_t *ctx, const renderer_t *renderer, FILE *output) {
+    if (ctx->target_count >= MAX_RENDER_TARGETS) {
+        fprintf(stderr, "Error: Demasiados formatos de salida (máximo %d)\n", MAX_RENDER_TARGETS);
+        return 0;
+    }
+
+    render_target_t *target = &ctx->targets[ctx->target_count++];
+    target->renderer = renderer;
+    target->output = output;
+    target->paragraph_open = 0;
+    target->code_open = 0;
+    target->pending_blank = 0;
+    // El buffer de código se conserva si el backend se vuelve a añadir en otra pasada
+    target->code_length = 0;
+    target->code_backticks = 0;
+    return 1;
+}
+
+void render_begin_document(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->begin_document) target->renderer->begin_document(ctx, target);
+    }
+}
+
+void render_end_document(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->end_document) target->renderer->end_document(ctx, target);
+    }
+}
+
+void render_heading(stroff_context_t *ctx, const char *title, int level, int index) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->heading) target->renderer->heading(ctx, target, title, level, index);
+    }
+}
+
+void render_paragraph(stroff_context_t *ctx, align_t align) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->paragraph) target->renderer->paragraph(ctx, target, align);
+    }
+}
+
+void render_text(stroff_context_t *ctx, const char *text, align_t align) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->text) target->renderer->text(ctx, target, text, align);
+    }
+}
+
+void render_line_break(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->line_break) target->renderer->line_break(ctx, target);
+    }
+}
+
+void render_list_begin(stroff_context_t *ctx, list_type_t type) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->list_begin) target->renderer->list_begin(ctx, target, type);
+    }
+}
+
+void render_list_item(stroff_context_t *ctx, const char *prefix, const char *text) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->list_item) target->renderer->list_item(ctx, target, prefix, text);
+    }
+}
+
+void render_list_end(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->list_end) target->renderer->list_end(ctx, target);
+    }
+}
+
+// Tablas por eventos: cabecera, filas y TLINE en el orden del documento. Las filas
+// pueden llegar de una en una (.TABLEFILE) sin tener la tabla entera en memoria
+void render_table_begin(stroff_context_t *ctx, const table_t *table) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->table_begin) target->renderer->table_begin(ctx, target, table);
+    }
+}
+
+void render_table_row(stroff_context_t *ctx, const table_t *table, int row) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->table_row) target->renderer->table_row(ctx, target, table, row);
+    }
+}
+
+void render_table_rule(stroff_context_t *ctx, const table_t *table) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->table_rule) target->renderer->table_rule(ctx, target, table);
+    }
+}
+
+void render_table_end(stroff_context_t *ctx, const table_t *table) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->table_end) target->renderer->table_end(ctx, target, table);
+    }
+}
+
+// Tabla completa en memoria. Varias TLINE seguidas producen una sola línea,
+// y la TLINE tras la cabecera solo se dibuja si hay cabecera
+void render_table(stroff_context_t *ctx, const table_t *table) {
+    render_table_begin(ctx, table);
+    if (table_has_headers(table) && table_has_rule_after(table, -1)) {
+        render_table_rule(ctx, table);
+    }
+
+    for (int row = 0; row < table->row_count; row++) {
+        render_table_row(ctx, table, row);
+        if (table_has_rule_after(table, row)) {
+            render_table_rule(ctx, table);
+        }
+    }
+
+    render_table_end(ctx, table);
+}
+
+void render_code_begin(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->code_begin) target->renderer->code_begin(ctx, target);
+    }
+}
+
+void render_code_line(stroff_context_t *ctx, const char *text) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->code_line) target->renderer->code_line(ctx, target, text);
+    }
+}
+
+void render_code_end(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->code_end) target->renderer->code_end(ctx, target);
+    }
+}
+
+// Un .CODE sin .ECODE se traga el resto del documento, .EDOC incluido: al terminar
+// se cierra en los backends que lo abrieron para que no pierdan lo ya guardado
+void render_close_code(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->code_open && target->renderer->code_end) target->renderer->code_end(ctx, target);
+    }
+}
+
+void render_toc(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->toc) target->renderer->toc(ctx, target);
+    }
+}
+
+void render_tot(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->tot) target->renderer->tot(ctx, target);
+    }
+}
+
+void render_index(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->index) target->renderer->index(ctx, target);
+    }
+}
+
+void render_page_break(stroff_context_t *ctx) {
+    for (int i = 0; i < ctx->target_count; i++) {
+        render_target_t *target = &ctx->targets[i];
+        if (target->renderer->page_break) target->renderer->page_break(ctx, target);
+    }
+}
@@ -16,7 +16,18 @@
 #define MAX_TABLES 50
 #define MAX_LIST_ITEMS 100
 #define MAX_TABLE_COLS 20
-#define MAX_TABLE_ROWS 100
+#define MAX_TEMPLATE_SEGMENTS 32
+#define MAX_PAGE_FIXUPS (MAX_CHAPTERS + MAX_TABLES)
+#define PAGE_NUMBER_WIDTH 4
+#define MAX_RENDER_TARGETS 4
+#define MAX_MACRO_PARAMS 9
+#define MAX_MACRO_DEPTH 16
+#define MAX_COND_DEPTH 32
+#define MAX_COMMAND_TOKENS 32
+#define MAX_COUNTING_PASSES 4      // Pasadas de conteo hasta que las {REF:} se estabilizan
+#define HYPHEN_CACHE_SIZE 4096      // Entradas de la caché de palabras (potencia de 2)
+#define HYPHEN_CACHE_WORD 32        // Palabras más largas se dividen sin caché
+#define HYPHEN_MAX_WORD 63          // Cortes posibles en un entero de 64 bits
 
 typedef enum {
     ALIGN_LEFT,
@@ -32,6 +43,29 @@ typedef enum {
     LIST_RNUMBER
 } list_type_t;
 
+typedef enum {
+    SEG_LITERAL,
+    SEG_TITLE,
+    SEG_CHAPTITLE,
+    SEG_SUBCHAP,
+    SEG_SUBSUBCHAP,
+    SEG_PAGE,
+    SEG_PAGES
+} segment_type_t;
+
+typedef struct {
+    segment_type_t type;
+    int offset;   // Inicio del literal dentro de source
+    int length;
+} template_segment_t;
+
+// Plantilla de header/footer compilada una sola vez al leer .HEADER/.FOOTER
+typedef struct {
+    char source[MAX_TITLE_LENGTH];
+    template_segment_t segments[MAX_TEMPLATE_SEGMENTS];
+    int segment_count;
+} text_template_t;
+
 typedef struct {
     char title[MAX_TITLE_LENGTH];
     char author[MAX_TITLE_LENGTH];
@@ -48,29 +82,106 @@ typedef struct {
     align_t head_align;
     char footer[MAX_TITLE_LENGTH];
     align_t foot_align;
+    int hyphenate;          // Índice en hyph_tries (-1 = sin división silábica)
 } document_params_t;
 
+typedef enum {
+    LAYOUT_FULL,      // Maquetación completa
+    LAYOUT_ESTIMATE,  // Solo cuenta líneas, con estimación barata del texto
+    LAYOUT_SKIP       // Sin maquetar: solo se procesan los cambios de estado
+} layout_mode_t;
+
 typedef struct {
     char title[MAX_TITLE_LENGTH];
     int level;
     int page;
+    int line;
+    int start_page;   // Estado al entrar en el encabezado, antes de cualquier salto:
+    int start_line;   // punto de reanudación para vistas previas
+    long start_offset;  // Byte de la salida donde se reanuda (-1 = no se puede reanudar ahí)
+    long offset;        // Byte de la salida donde empieza el encabezado (--index, -1 = sin dato)
 } chapter_t;
 
 typedef struct {
     char name[MAX_TITLE_LENGTH];
     int page;
+    long offset;        // Byte de la salida en el .TABLE (--index, -1 = sin dato)
 } table_ref_t;
 
+// --index: byte de la salida en el que empieza cada página
+typedef struct {
+    int page;
+    long offset;
+} page_offset_t;
+
+typedef enum {
+    FIXUP_CHAPTER,
+    FIXUP_TABLE
+} fixup_kind_t;
+
+// Campo de número de página reservado en TOC/TOT, se rellena al terminar la maquetación
+typedef struct {
+    long offset;
+    fixup_kind_t kind;
+    int index;
+} page_fixup_t;
+
+// Página en construcción: slot de header, cuerpo y, al cerrarla, relleno y footer.
+// Se escribe con una sola llamada al terminarla
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    size_t header_length;   // Bytes del slot de header al inicio del bloque
+    int has_header;
+} page_buffer_t;
+
+// Geometría derivada de los parámetros de página. update_page_geometry() la
+// recalcula solo cuando cambia un parámetro que la afecta (.PAGEWIDTH, .LMARGIN,
+// .HEADER...) o la reserva de header de la página; cada línea solo la lee
+typedef struct {
+    int content_width;      // page_width - left_margin - right_margin
+    int header_lines;       // Reservadas para el header en la página actual
+    int footer_lines;
+    int body_lines;         // Líneas de texto por página
+} page_geometry_t;
+
+// Celdas de una columna: offset en el pool de la tabla, longitud en bytes y ancho
+// visible. Arrays contiguos para que medir y renderizar recorran memoria densa
+typedef struct {
+    int *offsets;
+    int *lengths;
+    int *widths;
+} table_column_t;
+
+// Bloque .KEEP: se compone en el buffer de la página y, si no cabe en lo que queda
+// de ella, se traslada entero a la siguiente antes de escribirla
+typedef struct {
+    int active;
+    size_t start_offset;    // Inicio del bloque en el buffer de página
+    int start_line;
+    int fixup_start;
+    int chapter_start;
+    int table_ref_start;
+    int index_page_start;
+} keep_block_t;
+
 typedef struct {
     int cols;
     int widths[MAX_TABLE_COLS];
     align_t aligns[MAX_TABLE_COLS];
     char name[MAX_TITLE_LENGTH];
     char headers[MAX_TABLE_COLS][MAX_TITLE_LENGTH];
-    char data[MAX_TABLE_ROWS][MAX_TABLE_COLS][MAX_TITLE_LENGTH];
+    int header_widths[MAX_TABLE_COLS];
+    table_column_t columns[MAX_TABLE_COLS];
+    int allocated_cols;     // Columnas con arrays de row_capacity elementos
+    char *pool;             // Texto de todas las celdas, terminado en '\0' cada una
+    size_t pool_length;
+    size_t pool_capacity;
     int row_count;
-    int tline_after_row[MAX_TABLE_ROWS];  // -1 = after headers, 0+ = after row N
-    int tline_count;
+    int row_capacity;
+    unsigned char *rules;   // Bitset de TLINE: bit r+1 = línea tras la fila r, bit 0 = tras la cabecera
+    int auto_widths;        // WIDTHS=AUTO: anchos calculados a partir de las celdas
 } table_t;
 
 typedef struct {
@@ -81,12 +192,226 @@ typedef struct {
     int item_count;
 } list_t;
 
+// Patrones de división silábica compilados por tools/hyphc (bin/hyph_tables.c).
+// Las aristas de cada nodo están en [first_edge[n], first_edge[n + 1]), ordenadas por byte
+typedef struct {
+    const char *language;
+    int left_min;
+    int right_min;
+    const unsigned short *first_edge;
+    const unsigned char *edge_chars;
+    const unsigned short *edge_targets;
+    const unsigned short *node_values;  // Offset en values (0 = ningún patrón termina aquí)
+    const unsigned char *values;        // Número de posiciones seguido de sus dígitos
+} hyph_trie_t;
+
+extern const hyph_trie_t hyph_tries[];
+extern const int hyph_trie_count;
+
+typedef struct {
+    char word[HYPHEN_CACHE_WORD];
+    int language;
+    unsigned long long points;          // Bit i: corte permitido antes del byte i
+} hyphen_cache_entry_t;
+
+// Variable de usuario (.DEFINE NOMBRE "valor"), se expande como {NOMBRE}
 typedef struct {
+    char *name;
+    char *value;
+} define_t;
+
+typedef enum {
+    MACRO_SEG_LITERAL,
+    MACRO_SEG_PARAM,
+    MACRO_SEG_VARIABLE      // Variable de usuario: se busca al expandir
+} macro_segment_type_t;
+
+typedef struct {
+    macro_segment_type_t type;
+    int offset;             // Literal o nombre de la variable dentro de source
+    int length;
+    int param;
+} macro_segment_t;
+
+// Línea del cuerpo de una macro, troceada una sola vez al definirla.
+// Sin segmentos: la línea no tiene referencias y se ejecuta tal cual
+typedef struct {
+    char *source;
+    macro_segment_t *segments;
+    int segment_count;
+} macro_line_t;
+
+typedef struct {
+    char name[MAX_COMMAND_LENGTH];
+    char params[MAX_MACRO_PARAMS][MAX_COMMAND_LENGTH];
+    int param_count;
+    macro_line_t *lines;
+    int line_count;
+    int line_capacity;
+} macro_t;
+
+// Identidad de un archivo abierto (dispositivo + inodo), independiente de la ruta
+typedef struct {
+    unsigned long long device;
+    unsigned long long inode;
+} file_id_t;
+
+// Ruta ya resuelta de un .INCLUDE: clave "directorio base\nnombre" y resultado en el mismo bloque
+typedef struct {
+    unsigned int hash;
+    char *key;
+    const char *resolved;
+} include_cache_entry_t;
+
+// .LABEL, en una tabla hash abierta (label.c)
+typedef struct {
+    unsigned int hash;
+    char *id;               // NULL = hueco libre
+    int page;               // Página anotada por el último .LABEL maquetado
+    int known_page;         // Página al empezar la pasada: la que muestran las {REF:}
+    int defined;            // .LABEL visto en la pasada actual
+    int referenced;         // {REF:} vista en la pasada actual
+} label_t;
+
+// Término de .INDEX (keyindex.c). Sus páginas forman una lista enlazada en ctx->index_pages
+typedef struct {
+    unsigned int hash;
+    char *term;
+    int first;              // Primera página anotada en la pasada (-1 = ninguna)
+    int last;
+} index_term_t;
+
+typedef struct {
+    int page;
+    int next;               // Siguiente página del mismo término (-1 = última)
+} index_page_t;
+
+// Término del índice en orden alfabético (sort_index_terms)
+typedef struct {
+    int term;               // Posición en index_terms
+    unsigned char initial;  // Peso de la inicial: decide el grupo
+} index_order_t;
+
+// Argumentos de un comando ya separados (lexer.c)
+typedef enum {
+    TOKEN_WORD,
+    TOKEN_INT,
+    TOKEN_STRING,           // Entre comillas, sin ellas
+    TOKEN_KEY_VALUE         // CLAVE=valor o CLAVE="valor"
+} token_type_t;
+
+typedef enum {
+    KEY_COLS,
+    KEY_WIDTHS,
+    KEY_ALIGNS,
+    KEY_NAME,
+    KEY_SEP,
+    KEY_HEADER,
+    KEY_TYPE,
+    COMMAND_KEY_COUNT
+} command_key_t;
+
+typedef struct {
+    token_type_t type;
+    const char *text;       // Terminado en '\0' (el valor, en TOKEN_KEY_VALUE)
+    int length;
+    long number;            // Valor de TOKEN_INT, o de un valor entero de CLAVE=valor
+    int key;                // command_key_t de TOKEN_KEY_VALUE (-1 = clave desconocida)
+} command_token_t;
+
+typedef struct {
+    char name[MAX_COMMAND_LENGTH];
+    char text[MAX_LINE_LENGTH];     // Copia de la línea donde apuntan los tokens
+    command_token_t tokens[MAX_COMMAND_TOKENS];
+    int token_count;
+    int first_string;       // Índice del primer token de cada tipo (-1 = ninguno)
+    int first_int;
+    int first_word;
+    int keys[COMMAND_KEY_COUNT];
+} command_line_t;
+
+// Archivo fuente en memoria (--watch)
+typedef struct {
+    char *path;
+    char *data;             // NULL: hay que volver a leerlo
+    size_t length;
+    int first_chapter;      // Encabezados vistos al entrar por primera vez en la pasada (-1 = aún no)
+} source_file_t;
+
+// --async-write: hilo escritor con anillo de buffers (writer.c)
+typedef struct output_writer output_writer_t;
+
+// Documento precompilado .stc proyectado en memoria (compile.c)
+typedef struct compiled_document compiled_document_t;
+
+// Estado de la validación --check (check.c)
+typedef struct check_state check_state_t;
+
+typedef struct {
+    double write_ms;        // Tiempo del hilo escritor dentro de write/writev
+    double stall_ms;        // Tiempo de la maquetación esperando al hilo
+} io_stats_t;
+
+typedef struct stroff_context stroff_context_t;
+typedef struct render_target render_target_t;
+
+// Backend de salida: el parser interpreta el documento una vez y cada backend
+// recibe los mismos eventos. Un hook NULL ignora el evento
+typedef struct {
+    const char *name;
+    void (*begin_document)(stroff_context_t *ctx, render_target_t *target);
+    void (*end_document)(stroff_context_t *ctx, render_target_t *target);
+    void (*heading)(stroff_context_t *ctx, render_target_t *target, const char *title, int level, int index);
+    void (*paragraph)(stroff_context_t *ctx, render_target_t *target, align_t align);
+    void (*text)(stroff_context_t *ctx, render_target_t *target, const char *text, align_t align);
+    void (*line_break)(stroff_context_t *ctx, render_target_t *target);
+    void (*list_begin)(stroff_context_t *ctx, render_target_t *target, list_type_t type);
+    void (*list_item)(stroff_context_t *ctx, render_target_t *target, const char *prefix, const char *text);
+    void (*list_end)(stroff_context_t *ctx, render_target_t *target);
+    void (*table_begin)(stroff_context_t *ctx, render_target_t *target, const table_t *table);
+    void (*table_row)(stroff_context_t *ctx, render_target_t *target, const table_t *table, int row);
+    void (*table_rule)(stroff_context_t *ctx, render_target_t *target, const table_t *table);
+    void (*table_end)(stroff_context_t *ctx, render_target_t *target, const table_t *table);
+    void (*code_begin)(stroff_context_t *ctx, render_target_t *target);
+    void (*code_line)(stroff_context_t *ctx, render_target_t *target, const char *text);
+    void (*code_end)(stroff_context_t *ctx, render_target_t *target);
+    void (*toc)(stroff_context_t *ctx, render_target_t *target);
+    void (*tot)(stroff_context_t *ctx, render_target_t *target);
+    void (*index)(stroff_context_t *ctx, render_target_t *target);
+    void (*page_break)(stroff_context_t *ctx, render_target_t *target);
+} renderer_t;
+
+struct render_target {
+    const renderer_t *renderer;
+    FILE *output;           // NULL en el backend de texto: escribe a través del modelo de páginas
+    int paragraph_open;
+    int code_open;
+    int pending_blank;      // Separar el siguiente bloque con una línea en blanco
+    char *code_buffer;      // Markdown: el bloque de código se guarda hasta .ECODE
+    size_t code_length;
+    size_t code_capacity;
+    int code_backticks;     // Racha de ` más larga del bloque: la valla debe ser más larga
+};
+
+extern const renderer_t text_renderer;
+extern const renderer_t html_renderer;
+extern const renderer_t markdown_renderer;
+
+struct stroff_context {
     document_params_t params;
     chapter_t chapters[MAX_CHAPTERS];
-    int chapter_count;
+    int chapter_count;      // Entradas conocidas (recorrido previo incluido)
+    int chapter_index;      // Siguiente entrada a registrar en la pasada actual
     table_ref_t table_refs[MAX_TABLES];
     int table_ref_count;
+    int table_ref_index;
+    int outline_only;       // Recorrido previo: solo recoger estructura, sin maquetar
+    int needs_total_pages;  // Alguna plantilla usa {PAGES}
+    int needs_label_pages;  // El texto usa {REF:}
+    int use_fixups;         // La salida admite fseek para rellenar números de página
+    page_fixup_t fixups[MAX_PAGE_FIXUPS];
+    int fixup_count;
+    int fixup_pending;      // Primer campo reservado de la página aún sin volcar
     int current_page;
     int total_pages;
     int current_line;
@@ -102,14 +427,84 @@ typedef struct {
     table_t current_table;
     align_t current_paragraph_align;
     int first_line_of_paragraph;
+    text_template_t header_template;
+    text_template_t footer_template;
+    page_buffer_t page;
+    page_geometry_t geometry;
+    keep_block_t keep;
+    hyphen_cache_entry_t *hyphen_cache;  // Se reserva al dividir la primera palabra
+    define_t *defines;
+    int define_count;
+    int define_capacity;
+    macro_t *macros;
+    int macro_count;
+    int macro_capacity;
+    int recording_macro;    // Macro cuyo cuerpo se está leyendo (-1 = ninguna)
+    int macro_depth;        // Expansiones anidadas en curso
+    char **cli_defines;     // -D NOMBRE=valor: se aplican al empezar cada pasada
+    int cli_define_count;
+    int cond_depth;         // .IF abiertos
+    int cond_skip_from;     // Nivel del .IF cuyo bloque se salta (0 = ninguno)
+    unsigned char cond_else_seen[MAX_COND_DEPTH];
+    layout_mode_t layout_mode;
+    int resume_chapter;     // Entrada donde se reanuda la maquetación tras LAYOUT_SKIP (-1 = ninguna)
+    int stop_chapter;       // Entrada donde se detiene el procesamiento (-1 = ninguna)
+    int stop_after_range;   // Detenerse al pasar de last_output_page
+    int stop_processing;
+    int heading_start_page;
+    int heading_start_line;
+    long heading_start_offset;
+    long bytes_written;
+    int first_output_page;  // Rango de páginas a escribir (0 = sin límite)
+    int last_output_page;
     FILE *output;
+    output_writer_t *writer;    // --async-write: las páginas se entregan al hilo escritor
+    render_target_t targets[MAX_RENDER_TARGETS];  // targets[0] es siempre el backend de texto
+    int target_count;
     char include_stack[MAX_INCLUDE_DEPTH][MAX_PATH_LENGTH];
+    file_id_t include_files[MAX_INCLUDE_DEPTH];  // Para detectar ciclos de .INCLUDE
     int include_depth;
-} stroff_context_t;
+    char **include_dirs;    // -I, en el orden de la línea de comandos
+    int include_dir_count;
+    include_cache_entry_t *include_cache;  // Tabla hash abierta (tamaño potencia de 2)
+    int include_cache_size;
+    int include_cache_count;
+    int cache_sources;      // --watch: los archivos se leen de ctx->sources
+    source_file_t *sources;
+    int source_count;
+    int source_capacity;
+    int track_dependencies; // -M: el recorrido previo anota los archivos que abre
+    char **dependencies;
+    int dependency_count;
+    int dependency_capacity;
+    int build_index;        // --index: la pasada final anota offsets de páginas y encabezados
+    page_offset_t *page_offsets;
+    int page_offset_count;
+    int page_offset_capacity;
+    label_t *labels;        // Tabla hash abierta (tamaño potencia de 2)
+    int label_size;
+    int label_count;
+    index_term_t *index_terms;  // .INDEX, en orden de aparición
+    int index_term_count;
+    int index_term_capacity;
+    int *index_slots;       // Tabla hash de posiciones en index_terms (-1 = libre)
+    int index_slot_count;
+    index_page_t *index_pages;
+    int index_page_count;
+    int index_page_capacity;
+    compiled_document_t *compiled;  // Entrada precompilada (.stc) en lugar del documento fuente
+    check_state_t *check;   // --check: el recorrido previo valida el documento (NULL = no)
+    const char *source_path;    // Archivo que se está leyendo (NULL = ninguno)
+    int source_line;        // Línea de source_path, para situar los errores
+};
 
 void init_context(stroff_context_t *ctx);
+void free_context(stroff_context_t *ctx);
+void begin_pass(stroff_context_t *ctx);
 void process_file(stroff_context_t *ctx, const char *filename);
 void process_line(stroff_context_t *ctx, const char *line);
+void process_expanded_line(stroff_context_t *ctx, const char *line);
+void process_trimmed_line(stroff_context_t *ctx, const char *trimmed);
 void process_command(stroff_context_t *ctx, const char *line);
 void process_text(stroff_context_t *ctx, const char *text);
 void output_text(stroff_context_t *ctx, const char *text, align_t align);
@@ -118,14 +513,158 @@ void output_header(stroff_context_t *ctx);
 void output_footer(stroff_context_t *ctx);
 void output_toc(stroff_context_t *ctx);
 void output_tot(stroff_context_t *ctx);
-void new_page(stroff_context_t *ctx);
-void check_page_break(stroff_context_t *ctx, int lines_needed);
+void output_index(stroff_context_t *ctx);
 void output_line(stroff_context_t *ctx, const char *text);
+void output_raw(stroff_context_t *ctx, const char *text, int len);
+void output_string(stroff_context_t *ctx, const char *text);
+void output_spaces(stroff_context_t *ctx, int count);
+void output_newline(stroff_context_t *ctx);
+void update_page_geometry(stroff_context_t *ctx);
+int page_lines_remaining(stroff_context_t *ctx);
+void start_page(stroff_context_t *ctx);
+void finish_page(stroff_context_t *ctx);
+void new_page(stroff_context_t *ctx);
+int check_page_break(stroff_context_t *ctx, int lines_needed);
+void output_blank_line(stroff_context_t *ctx);
+void begin_keep(stroff_context_t *ctx);
+void end_keep(stroff_context_t *ctx);
+void flush_output(stroff_context_t *ctx);
+void count_pages(stroff_context_t *ctx, const char *input_path);
+int load_page_map(stroff_context_t *ctx, const char *path);
+int save_page_map(stroff_context_t *ctx, const char *path);
+
+// Escritura asíncrona (--async-write)
+output_writer_t *start_output_writer(FILE *output);
+void writer_append(output_writer_t *writer, const char *data, size_t length);
+int finish_output_writer(output_writer_t *writer, FILE *output, io_stats_t *stats);
+void print_io_stats(const io_stats_t *stats);
+
+// Documento precompilado (--compile)
+int compile_document(stroff_context_t *ctx, const char *input_path, const char *output_path);
+int open_compiled_document(stroff_context_t *ctx, const char *path);
+void replay_compiled_document(stroff_context_t *ctx);
+void free_compiled_document(stroff_context_t *ctx);
+
+// Validación sin maquetar (--check)
+void report_error(const stroff_context_t *ctx, const char *format, ...);
+void begin_error(const stroff_context_t *ctx);
+void check_command(stroff_context_t *ctx, const char *line, const command_line_t *cmd);
+int check_documents(const char **paths, int count, const char **defines, int define_count,
+                    const char **include_dirs, int include_dir_count);
+
+// Índice de offsets (--index)
+long output_offset(stroff_context_t *ctx);
+void record_page_offset(stroff_context_t *ctx);
+int save_page_index(stroff_context_t *ctx, const char *path, const char *output_path);
+void free_page_index(stroff_context_t *ctx);
+
+// Referencias cruzadas (.LABEL y {REF:})
+void define_label(stroff_context_t *ctx, const char *id);
+const char *label_reference(stroff_context_t *ctx, const char *id, int len, char *buffer, int size);
+void set_label_page(stroff_context_t *ctx, const char *id, int page);
+void begin_label_pass(stroff_context_t *ctx);
+int labels_changed(const stroff_context_t *ctx);
+void report_unresolved_labels(const stroff_context_t *ctx);
+void free_labels(stroff_context_t *ctx);
+
+// Índice alfabético (.INDEX y .MAKEINDEX)
+void add_index_entry(stroff_context_t *ctx, const char *term);
+void begin_index_pass(stroff_context_t *ctx);
+index_order_t *sort_index_terms(stroff_context_t *ctx, int *count);
+const char *index_group_heading(unsigned char weight, char *buffer);
+int format_index_pages(const stroff_context_t *ctx, const index_term_t *entry, char **buffer, int *capacity);
+void free_keyword_index(stroff_context_t *ctx);
+
+// Rutas de inclusión
+void resolve_include_path(stroff_context_t *ctx, const char *filename, char *resolved);
+void add_include_dir(stroff_context_t *ctx, const char *dir);
+int enter_include(stroff_context_t *ctx, const char *resolved_path);
+int enter_compiled_include(stroff_context_t *ctx, const char *resolved_path);
+void leave_include(stroff_context_t *ctx);
+void free_include_paths(stroff_context_t *ctx);
+int process_cached_source(stroff_context_t *ctx, const char *path);
+void invalidate_source(stroff_context_t *ctx, const char *path);
+void reset_source_positions(stroff_context_t *ctx);
+void free_sources(stroff_context_t *ctx);
+
+// Dependencias (-M)
+void add_dependency(stroff_context_t *ctx, const char *path);
+int write_depfile(stroff_context_t *ctx, const char *path, const char *target);
+void free_dependencies(stroff_context_t *ctx);
+
+// Vigilancia de archivos (--watch)
+int watch_document(stroff_context_t *ctx, const char *input_path, const char *output_path,
+                   const char *depfile_path);
+
+int add_render_target(stroff_context_t *ctx, const renderer_t *renderer, FILE *output);
+void table_reset(table_t *table, int cols);
+void table_set_cols(table_t *table, int cols);
+int table_add_row(table_t *table);
+void table_clear_rows(table_t *table);
+void table_set_cell(table_t *table, int row, int col, const char *text, int len);
+void table_add_rule(table_t *table);
+int table_has_rule_after(const table_t *table, int row);
+void table_free(table_t *table);
+int table_has_headers(const table_t *table);
+const char *table_cell(const table_t *table, int row, int col);
+int table_cell_width(const table_t *table, int row, int col);
+void fit_table_widths(stroff_context_t *ctx, table_t *table);
+void fit_table_columns(stroff_context_t *ctx, table_t *table, const int *natural);
+void import_table_file(stroff_context_t *ctx, const char *path, char delimiter, int has_header);
+void render_begin_document(stroff_context_t *ctx);
+void render_end_document(stroff_context_t *ctx);
+void render_heading(stroff_context_t *ctx, const char *title, int level, int index);
+void render_paragraph(stroff_context_t *ctx, align_t align);
+void render_text(stroff_context_t *ctx, const char *text, align_t align);
+void render_line_break(stroff_context_t *ctx);
+void render_list_begin(stroff_context_t *ctx, list_type_t type);
+void render_list_item(stroff_context_t *ctx, const char *prefix, const char *text);
+void render_list_end(stroff_context_t *ctx);
+void render_table(stroff_context_t *ctx, const table_t *table);
+void render_table_begin(stroff_context_t *ctx, const table_t *table);
+void render_table_row(stroff_context_t *ctx, const table_t *table, int row);
+void render_table_rule(stroff_context_t *ctx, const table_t *table);
+void render_table_end(stroff_context_t *ctx, const table_t *table);
+void render_code_begin(stroff_context_t *ctx);
+void render_code_line(stroff_context_t *ctx, const char *text);
+void render_code_end(stroff_context_t *ctx);
+void render_close_code(stroff_context_t *ctx);
+void render_toc(stroff_context_t *ctx);
+void render_tot(stroff_context_t *ctx);
+void render_index(stroff_context_t *ctx);
+void render_page_break(stroff_context_t *ctx);
+void record_page_fixup(stroff_context_t *ctx, fixup_kind_t kind, int index);
+void resolve_page_fixups(stroff_context_t *ctx);
 char *trim_whitespace(char *str);
-char *extract_string_param(const char *line, const char *param);
-int extract_int_param(const char *line, const char *param);
+void lex_command(const char *line, command_line_t *cmd);
+const char *command_string(const command_line_t *cmd);
+const char *command_word(const command_line_t *cmd);
+int command_int(const command_line_t *cmd);
+const command_token_t *command_key(const command_line_t *cmd, command_key_t key);
+int command_key_int(const command_line_t *cmd, command_key_t key);
 align_t parse_align(const char *align_str);
 int utf8_display_width(const char *str);
-void substitute_variables(stroff_context_t *ctx, char *text);
+
+// Variables y macros
+const char *expand_variables(stroff_context_t *ctx, const char *line, char *out, int out_size);
+int record_macro_line(stroff_context_t *ctx, const char *line);
+int handle_macro_command(stroff_context_t *ctx, const char *line);
+const char *lookup_define(stroff_context_t *ctx, const char *name, int len);
+void add_command_line_define(stroff_context_t *ctx, const char *spec);
+void clear_macros(stroff_context_t *ctx);
+void free_macros(stroff_context_t *ctx);
+
+// Compilación condicional
+int handle_conditional(stroff_context_t *ctx, const char *line);
+void skip_conditional_line(stroff_context_t *ctx, const char *line);
+void reset_conditionals(stroff_context_t *ctx);
+void check_conditionals_closed(stroff_context_t *ctx);
+
+// División silábica
+int find_hyphen_language(const char *name);
+int hyphen_split_point(stroff_context_t *ctx, const char *word, int max_length);
+void free_hyphen_cache(stroff_context_t *ctx);
+void compile_template(text_template_t *tpl, const char *text);
+int render_template(stroff_context_t *ctx, const text_template_t *tpl, char *out, int out_size);
 
 #endif
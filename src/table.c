@@ -0,0 +1,188 @@
+#include "stroff.h"
+
+// Almacenamiento columnar de tablas: el texto de las celdas va a un único pool y cada
+// columna guarda offset, longitud y ancho visible en arrays propios. La memoria crece
+// con el contenido y se reutiliza de una tabla a la siguiente
+
+static void *table_realloc(void *data, size_t size) {
+    void *grown = realloc(data, size);
+    if (!grown) {
+        fprintf(stderr, "Error: Memoria insuficiente para la tabla\n");
+        exit(1);
+    }
+    return grown;
+}
+
+static void table_resize_column(table_column_t *column, int capacity) {
+    column->offsets = table_realloc(column->offsets, sizeof(int) * capacity);
+    column->lengths = table_realloc(column->lengths, sizeof(int) * capacity);
+    column->widths = table_realloc(column->widths, sizeof(int) * capacity);
+}
+
+static void table_reserve_rows(table_t *table, int rows) {
+    if (rows <= table->row_capacity) return;
+
+    int capacity = table->row_capacity ? table->row_capacity : 64;
+    while (capacity < rows) {
+        capacity *= 2;
+    }
+
+    for (int col = 0; col < table->allocated_cols; col++) {
+        table_resize_column(&table->columns[col], capacity);
+    }
+
+    // Bits 0..capacity: cabecera más una posición por fila
+    size_t old_bytes = table->row_capacity ? (size_t)table->row_capacity / 8 + 1 : 0;
+    size_t new_bytes = (size_t)capacity / 8 + 1;
+    table->rules = table_realloc(table->rules, new_bytes);
+    memset(table->rules + old_bytes, 0, new_bytes - old_bytes);
+
+    table->row_capacity = capacity;
+}
+
+static int table_pool_append(table_t *table, const char *text, int len) {
+    size_t needed = table->pool_length + (size_t)len + 1;
+    if (needed > table->pool_capacity) {
+        size_t capacity = table->pool_capacity ? table->pool_capacity : 4096;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        table->pool = table_realloc(table->pool, capacity);
+        table->pool_capacity = capacity;
+    }
+
+    int offset = (int)table->pool_length;
+    memcpy(table->pool + offset, text, (size_t)len);
+    table->pool[offset + len] = '\0';
+    table->pool_length = needed;
+    return offset;
+}
+
+// Número de columnas de una tabla aún sin filas; las columnas nuevas empiezan vacías
+void table_set_cols(table_t *table, int cols) {
+    if (cols > MAX_TABLE_COLS) cols = MAX_TABLE_COLS;
+    if (cols < 0) cols = 0;
+
+    for (int col = table->allocated_cols; col < cols; col++) {
+        if (table->row_capacity > 0) {
+            table_resize_column(&table->columns[col], table->row_capacity);
+        }
+    }
+    if (cols > table->allocated_cols) {
+        table->allocated_cols = cols;
+    }
+
+    for (int col = table->cols; col < cols; col++) {
+        table->headers[col][0] = '\0';
+        table->header_widths[col] = 0;
+    }
+    table->cols = cols;
+}
+
+void table_reset(table_t *table, int cols) {
+    table->cols = 0;
+    table_set_cols(table, cols);
+
+    if (table->row_capacity > 0) {
+        memset(table->rules, 0, (size_t)table->row_capacity / 8 + 1);
+    }
+    for (int col = 0; col < MAX_TABLE_COLS; col++) {
+        table->aligns[col] = ALIGN_LEFT;
+    }
+    table->name[0] = '\0';
+    table->row_count = 0;
+
+    // Offset 0 del pool: celda vacía compartida
+    table->pool_length = 0;
+    table_pool_append(table, "", 0);
+}
+
+// Nueva fila con todas las celdas vacías; devuelve su índice
+int table_add_row(table_t *table) {
+    table_reserve_rows(table, table->row_count + 1);
+
+    int row = table->row_count++;
+    for (int col = 0; col < table->cols; col++) {
+        table->columns[col].offsets[row] = 0;
+        table->columns[col].lengths[row] = 0;
+        table->columns[col].widths[row] = 0;
+    }
+    return row;
+}
+
+// Descarta las filas conservando columnas, cabecera y anchos: .TABLEFILE renderiza
+// cada fila al leerla y reutiliza el mismo espacio
+void table_clear_rows(table_t *table) {
+    table->row_count = 0;
+    table->pool_length = 1;
+}
+
+// Fila -1: cabecera (.TH). El ancho visible se mide aquí una sola vez
+void table_set_cell(table_t *table, int row, int col, const char *text, int len) {
+    if (col < 0 || col >= table->cols) return;
+
+    if (row < 0) {
+        if (len > MAX_TITLE_LENGTH - 1) len = MAX_TITLE_LENGTH - 1;
+        memcpy(table->headers[col], text, (size_t)len);
+        table->headers[col][len] = '\0';
+        table->header_widths[col] = utf8_display_width(table->headers[col]);
+        return;
+    }
+
+    table_column_t *column = &table->columns[col];
+    int offset = table_pool_append(table, text, len);
+    column->offsets[row] = offset;
+    column->lengths[row] = len;
+    column->widths[row] = utf8_display_width(table->pool + offset);
+}
+
+// .TLINE: línea tras la última fila leída (o tras la cabecera si aún no hay filas)
+void table_add_rule(table_t *table) {
+    table_reserve_rows(table, table->row_count + 1);
+    int bit = table->row_count;
+    table->rules[bit / 8] |= (unsigned char)(1u << (bit % 8));
+}
+
+int table_has_rule_after(const table_t *table, int row) {
+    int bit = row + 1;
+    if (bit < 0 || bit > table->row_capacity || !table->rules) return 0;
+    return (table->rules[bit / 8] >> (bit % 8)) & 1;
+}
+
+void table_free(table_t *table) {
+    for (int col = 0; col < table->allocated_cols; col++) {
+        free(table->columns[col].offsets);
+        free(table->columns[col].lengths);
+        free(table->columns[col].widths);
+        table->columns[col].offsets = NULL;
+        table->columns[col].lengths = NULL;
+        table->columns[col].widths = NULL;
+    }
+    free(table->pool);
+    free(table->rules);
+    table->pool = NULL;
+    table->rules = NULL;
+    table->pool_length = 0;
+    table->pool_capacity = 0;
+    table->allocated_cols = 0;
+    table->row_capacity = 0;
+    table->row_count = 0;
+}
+
+int table_has_headers(const table_t *table) {
+    for (int col = 0; col < table->cols; col++) {
+        if (table->headers[col][0] != '\0') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Fila -1: cabecera (.TH)
+const char *table_cell(const table_t *table, int row, int col) {
+    return row < 0 ? table->headers[col] : table->pool + table->columns[col].offsets[row];
+}
+
+int table_cell_width(const table_t *table, int row, int col) {
+    return row < 0 ? table->header_widths[col] : table->columns[col].widths[row];
+}
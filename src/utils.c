@@ -13,37 +13,6 @@ char *trim_whitespace(char *str) {
     return str;
 }
 
-char *extract_string_param(const char *line, const char *param) {
-    const char *param_pos = strstr(line, param);
-    if (!param_pos) return NULL;
-
-    const char *quote_start = strchr(param_pos, '"');
-    if (!quote_start) return NULL;
-
-    quote_start++;
-    const char *quote_end = strchr(quote_start, '"');
-    if (!quote_end) return NULL;
-
-    int len = quote_end - quote_start;
-    char *result = malloc(len + 1);
-    strncpy(result, quote_start, len);
-    result[len] = '\0';
-
-    return result;
-}
-
-int extract_int_param(const char *line, const char *param) {
-    const char *param_pos = strstr(line, param);
-    if (!param_pos) return 0;
-
-    param_pos += strlen(param);
-    while (*param_pos && !isdigit(*param_pos) && *param_pos != '-') {
-        param_pos++;
-    }
-
-    return atoi(param_pos);
-}
-
 align_t parse_align(const char *align_str) {
     if (strncmp(align_str, "LEFT", 4) == 0) {
         return ALIGN_LEFT;
@@ -0,0 +1,474 @@
+// clock_gettime y CLOCK_MONOTONIC no forman parte de C99
+#define _POSIX_C_SOURCE 200809L
+
+#include "stroff.h"
+
+// --watch: reconstruye la salida cada vez que cambia el documento o uno de sus
+// includes. Los fuentes, la caché de rutas y la de división silábica siguen en
+// memoria entre reconstrucciones; solo se vuelven a leer los archivos cambiados.
+// Si la estructura de capítulos no cambia, la salida anterior se conserva hasta el
+// último encabezado previo al primer archivo cambiado y se maqueta solo desde ahí
+
+#ifdef __linux__
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+#define WATCH_SETTLE_MS 50      // Un guardado puede generar varios eventos seguidos
+#define WATCH_COPY_CHUNK 65536
+
+// Maquetación de la última reconstrucción, para reanudar la siguiente
+typedef struct {
+    chapter_t *chapters;
+    int chapter_count;
+    table_ref_t table_refs[MAX_TABLES];
+    int table_ref_count;
+    page_fixup_t fixups[MAX_PAGE_FIXUPS];
+    int fixup_count;
+    int total_pages;
+    int inotify_fd;
+    int *watches;           // Descriptor de inotify del directorio de cada dependencia
+    int watch_capacity;
+    char **watched_dirs;    // Directorios ya registrados en inotify
+    int *watched_wds;
+    int watched_count;
+    int watched_capacity;
+} watch_state_t;
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1000.0 + (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void read_outline(stroff_context_t *ctx, const char *input_path) {
+    free_dependencies(ctx);
+    ctx->output = NULL;
+    begin_pass(ctx);
+    ctx->chapter_count = 0;
+    ctx->table_ref_count = 0;
+    ctx->needs_total_pages = 0;
+    ctx->needs_label_pages = 0;
+    ctx->outline_only = 1;
+    process_file(ctx, input_path);
+    ctx->outline_only = 0;
+}
+
+static int same_structure(const stroff_context_t *ctx, const watch_state_t *state) {
+    if (ctx->chapter_count != state->chapter_count || ctx->table_ref_count != state->table_ref_count) {
+        return 0;
+    }
+    for (int i = 0; i < ctx->chapter_count; i++) {
+        if (ctx->chapters[i].level != state->chapters[i].level ||
+            strcmp(ctx->chapters[i].title, state->chapters[i].title) != 0) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < ctx->table_ref_count; i++) {
+        if (strcmp(ctx->table_refs[i].name, state->table_refs[i].name) != 0) return 0;
+    }
+    return 1;
+}
+
+// Se llama antes de resolve_page_fixups, que vacía la lista de campos
+static void save_layout(watch_state_t *state, const stroff_context_t *ctx) {
+    memcpy(state->chapters, ctx->chapters, sizeof(chapter_t) * (size_t)ctx->chapter_count);
+    state->chapter_count = ctx->chapter_count;
+    memcpy(state->table_refs, ctx->table_refs, sizeof(table_ref_t) * (size_t)ctx->table_ref_count);
+    state->table_ref_count = ctx->table_ref_count;
+    memcpy(state->fixups, ctx->fixups, sizeof(page_fixup_t) * (size_t)ctx->fixup_count);
+    state->fixup_count = ctx->fixup_count;
+    state->total_pages = ctx->current_page;
+}
+
+static void restore_layout(stroff_context_t *ctx, const watch_state_t *state) {
+    for (int i = 0; i < state->chapter_count; i++) {
+        chapter_t *chapter = &ctx->chapters[i];
+        chapter->page = state->chapters[i].page;
+        chapter->line = state->chapters[i].line;
+        chapter->start_page = state->chapters[i].start_page;
+        chapter->start_line = state->chapters[i].start_line;
+        chapter->start_offset = state->chapters[i].start_offset;
+    }
+    for (int i = 0; i < state->table_ref_count; i++) {
+        ctx->table_refs[i].page = state->table_refs[i].page;
+    }
+    ctx->total_pages = state->total_pages;
+}
+
+// La salida se escribe en "<salida>.tmp" y sustituye a la anterior de una vez
+static void temp_path(const char *output_path, char *tmp) {
+    snprintf(tmp, MAX_PATH_LENGTH, "%s.tmp", output_path);
+}
+
+// "<salida>.tmp" de la reconstrucción en curso: Ctrl+C no debe dejarlo a medias
+static char interrupted_temp[MAX_PATH_LENGTH];
+
+static void remove_temp_and_exit(int sig) {
+    unlink(interrupted_temp);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void install_interrupt_handler(const char *output_path) {
+    temp_path(output_path, interrupted_temp);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = remove_temp_and_exit;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+}
+
+static int replace_output(stroff_context_t *ctx, const char *tmp, const char *output_path) {
+    resolve_page_fixups(ctx);
+    int ok = fclose(ctx->output) == 0;
+    ctx->output = NULL;
+    if (!ok || rename(tmp, output_path) != 0) {
+        fprintf(stderr, "Error: No se puede escribir el archivo de salida '%s'\n", output_path);
+        remove(tmp);
+        return 0;
+    }
+    return 1;
+}
+
+static int full_build(stroff_context_t *ctx, watch_state_t *state, const char *input_path,
+                      const char *output_path) {
+    char tmp[MAX_PATH_LENGTH];
+    temp_path(output_path, tmp);
+    FILE *output = fopen(tmp, "w");
+    if (!output) {
+        fprintf(stderr, "Error: No se puede abrir el archivo de salida '%s'\n", tmp);
+        return 0;
+    }
+    ctx->use_fixups = 1;
+
+    // El total y las etiquetas de la reconstrucción anterior evitan la pasada de
+    // conteo: la pasada final cuenta sus páginas y solo se repite si algo cambió
+    int needs_pages = ctx->needs_total_pages || ctx->needs_label_pages;
+    int guess = needs_pages ? state->total_pages : 0;
+    if (needs_pages && guess == 0) {
+        count_pages(ctx, input_path);
+    } else if (guess > 0) {
+        ctx->total_pages = guess;
+    }
+
+    ctx->output = output;
+    begin_pass(ctx);
+    process_file(ctx, input_path);
+    flush_output(ctx);
+
+    if (guess > 0 && (ctx->current_page != guess || labels_changed(ctx))) {
+        ctx->total_pages = ctx->current_page;
+        ctx->output = freopen(tmp, "w", output);
+        if (!ctx->output) {
+            fprintf(stderr, "Error: No se puede abrir el archivo de salida '%s'\n", tmp);
+            return 0;
+        }
+        begin_pass(ctx);
+        process_file(ctx, input_path);
+        flush_output(ctx);
+    }
+    report_unresolved_labels(ctx);
+    save_layout(state, ctx);
+    return replace_output(ctx, tmp, output_path);
+}
+
+static int copy_prefix(const char *path, FILE *output, long length) {
+    FILE *previous = fopen(path, "rb");
+    if (!previous) return 0;
+
+    char *chunk = malloc(WATCH_COPY_CHUNK);
+    long remaining = length;
+    while (chunk && remaining > 0) {
+        size_t wanted = remaining < WATCH_COPY_CHUNK ? (size_t)remaining : WATCH_COPY_CHUNK;
+        size_t read = fread(chunk, 1, wanted, previous);
+        if (read == 0 || fwrite(chunk, 1, read, output) != read) break;
+        remaining -= (long)read;
+    }
+    free(chunk);
+    fclose(previous);
+    return remaining == 0;
+}
+
+// Maqueta desde el encabezado resume. Devuelve 0 si hace falta una reconstrucción
+// completa (p.ej. cambió el total de páginas que muestran los headers)
+static int incremental_build(stroff_context_t *ctx, watch_state_t *state, const char *input_path,
+                             const char *output_path, int resume) {
+    // Las páginas de .INDEX de la parte conservada no se vuelven a anotar
+    if (ctx->index_term_count > 0) return 0;
+
+    long prefix = state->chapters[resume].start_offset;
+    char tmp[MAX_PATH_LENGTH];
+    temp_path(output_path, tmp);
+    FILE *output = fopen(tmp, "w");
+    if (!output) return 0;
+    if (!copy_prefix(output_path, output, prefix)) {
+        fclose(output);
+        remove(tmp);
+        return 0;
+    }
+
+    restore_layout(ctx, state);
+    ctx->use_fixups = 1;
+    ctx->output = output;
+    begin_pass(ctx);
+    ctx->bytes_written = prefix;
+    ctx->layout_mode = LAYOUT_SKIP;
+    ctx->resume_chapter = resume;
+    process_file(ctx, input_path);
+    flush_output(ctx);
+
+    // Una etiqueta que cambia de página invalida las {REF:} de la parte conservada
+    if (ctx->layout_mode != LAYOUT_FULL || (ctx->needs_total_pages && ctx->current_page != state->total_pages) ||
+        labels_changed(ctx)) {
+        // Maquetado hasta el final, el total contado es el real: la reconstrucción
+        // completa lo toma como supuesto
+        if (ctx->layout_mode == LAYOUT_FULL) state->total_pages = ctx->current_page;
+        fclose(output);
+        ctx->output = NULL;
+        remove(tmp);
+        return 0;
+    }
+
+    // Los campos de TOC/TOT de la parte conservada se rellenan otra vez con las páginas nuevas
+    int kept = 0;
+    while (kept < state->fixup_count && state->fixups[kept].offset < prefix) kept++;
+    if (kept + ctx->fixup_count > MAX_PAGE_FIXUPS) {
+        ctx->fixup_count = MAX_PAGE_FIXUPS - kept;
+    }
+    memmove(ctx->fixups + kept, ctx->fixups, sizeof(page_fixup_t) * (size_t)ctx->fixup_count);
+    memcpy(ctx->fixups, state->fixups, sizeof(page_fixup_t) * (size_t)kept);
+    ctx->fixup_count += kept;
+    ctx->fixup_pending = ctx->fixup_count;
+
+    report_unresolved_labels(ctx);
+    save_layout(state, ctx);
+    return replace_output(ctx, tmp, output_path);
+}
+
+// Último encabezado anterior a la primera entrada en un archivo cambiado en el
+// que se pueda reanudar; -1 si hay que maquetar desde el principio
+static int find_resume_chapter(stroff_context_t *ctx, const watch_state_t *state,
+                               const unsigned char *changed) {
+    int first = state->chapter_count;
+    for (int i = 0; i < ctx->dependency_count; i++) {
+        if (!changed[i]) continue;
+        int chapter = -1;
+        for (int j = 0; j < ctx->source_count; j++) {
+            if (strcmp(ctx->sources[j].path, ctx->dependencies[i]) == 0) {
+                chapter = ctx->sources[j].first_chapter;
+                break;
+            }
+        }
+        // .TABLEFILE u otro archivo que no pasa por la caché: se desconoce su posición
+        if (chapter < 0) return -1;
+        if (chapter < first) first = chapter;
+    }
+
+    int resume = first - 1;
+    while (resume >= 0 && state->chapters[resume].start_offset < 0) resume--;
+    return resume;
+}
+
+// Descriptor de inotify de un directorio; solo se registra la primera vez
+static int find_watch(watch_state_t *state, const char *dir) {
+    for (int i = 0; i < state->watched_count; i++) {
+        if (strcmp(state->watched_dirs[i], dir) == 0) return state->watched_wds[i];
+    }
+
+    int wd = inotify_add_watch(state->inotify_fd, dir, WATCH_EVENTS);
+    if (wd < 0) {
+        fprintf(stderr, "Error: No se puede vigilar el directorio '%s'\n", dir);
+        return wd;
+    }
+
+    if (state->watched_count == state->watched_capacity) {
+        int capacity = state->watched_capacity ? state->watched_capacity * 2 : 8;
+        char **dirs = realloc(state->watched_dirs, sizeof(char *) * (size_t)capacity);
+        if (dirs) state->watched_dirs = dirs;
+        int *wds = realloc(state->watched_wds, sizeof(int) * (size_t)capacity);
+        if (wds) state->watched_wds = wds;
+        if (!dirs || !wds) {
+            fprintf(stderr, "Error: Memoria insuficiente para vigilar los archivos\n");
+            exit(1);
+        }
+        state->watched_capacity = capacity;
+    }
+    size_t len = strlen(dir) + 1;
+    char *copy = malloc(len);
+    if (!copy) {
+        fprintf(stderr, "Error: Memoria insuficiente para vigilar los archivos\n");
+        exit(1);
+    }
+    memcpy(copy, dir, len);
+    state->watched_dirs[state->watched_count] = copy;
+    state->watched_wds[state->watched_count] = wd;
+    state->watched_count++;
+    return wd;
+}
+
+static void watch_dependencies(stroff_context_t *ctx, watch_state_t *state) {
+    if (ctx->dependency_count > state->watch_capacity) {
+        int *grown = realloc(state->watches, sizeof(int) * (size_t)ctx->dependency_count);
+        if (!grown) {
+            fprintf(stderr, "Error: Memoria insuficiente para vigilar los archivos\n");
+            exit(1);
+        }
+        state->watches = grown;
+        state->watch_capacity = ctx->dependency_count;
+    }
+
+    // Se vigila el directorio y no el archivo: los editores que guardan escribiendo
+    // un archivo nuevo y renombrándolo cambian el inodo
+    for (int i = 0; i < ctx->dependency_count; i++) {
+        const char *path = ctx->dependencies[i];
+        const char *slash = strrchr(path, '/');
+        char dir[MAX_PATH_LENGTH];
+        if (!slash) {
+            strcpy(dir, ".");
+        } else {
+            size_t len = slash == path ? 1 : (size_t)(slash - path);
+            if (len >= MAX_PATH_LENGTH) len = MAX_PATH_LENGTH - 1;
+            memcpy(dir, path, len);
+            dir[len] = '\0';
+        }
+        state->watches[i] = find_watch(state, dir);
+    }
+}
+
+static int mark_changed(stroff_context_t *ctx, const watch_state_t *state,
+                        const struct inotify_event *event, unsigned char *changed) {
+    int count = 0;
+    if (event->len == 0) return 0;
+
+    for (int i = 0; i < ctx->dependency_count; i++) {
+        if (state->watches[i] != event->wd || changed[i]) continue;
+        const char *slash = strrchr(ctx->dependencies[i], '/');
+        const char *name = slash ? slash + 1 : ctx->dependencies[i];
+        if (strcmp(name, event->name) == 0) {
+            changed[i] = 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+// Espera hasta que cambie alguna dependencia y deja que terminen de llegar los
+// eventos del mismo guardado. Devuelve el número de dependencias cambiadas
+static int wait_for_changes(stroff_context_t *ctx, const watch_state_t *state, unsigned char *changed) {
+    // La unión alinea el buffer para leer los eventos en su sitio
+    union {
+        char bytes[4096];
+        struct inotify_event event;
+    } buffer;
+    int count = 0;
+
+    memset(changed, 0, (size_t)ctx->dependency_count);
+    for (;;) {
+        struct pollfd fds = {state->inotify_fd, POLLIN, 0};
+        int ready = poll(&fds, 1, count > 0 ? WATCH_SETTLE_MS : -1);
+        if (ready < 0) return -1;
+        if (ready == 0) return count;
+
+        ssize_t length = read(state->inotify_fd, buffer.bytes, sizeof(buffer.bytes));
+        if (length <= 0) return -1;
+
+        for (char *p = buffer.bytes; p < buffer.bytes + length;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            count += mark_changed(ctx, state, event, changed);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+int watch_document(stroff_context_t *ctx, const char *input_path, const char *output_path,
+                   const char *depfile_path) {
+    watch_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.chapters = malloc(sizeof(chapter_t) * MAX_CHAPTERS);
+    state.inotify_fd = inotify_init();
+    if (!state.chapters || state.inotify_fd < 0) {
+        fprintf(stderr, "Error: No se puede iniciar la vigilancia de archivos\n");
+        free(state.chapters);
+        return 1;
+    }
+
+    ctx->cache_sources = 1;
+    ctx->track_dependencies = 1;
+    install_interrupt_handler(output_path);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    read_outline(ctx, input_path);
+    if (depfile_path) write_depfile(ctx, depfile_path, output_path);
+    // Sin documento principal no hay nada que vigilar
+    if (ctx->dependency_count == 0 || !full_build(ctx, &state, input_path, output_path)) {
+        free(state.chapters);
+        close(state.inotify_fd);
+        return 1;
+    }
+    fprintf(stderr, "'%s' generado en %.1f ms; vigilando %d archivos (Ctrl+C para salir)\n",
+            output_path, elapsed_ms(&start), ctx->dependency_count);
+
+    unsigned char *changed = NULL;
+    for (;;) {
+        watch_dependencies(ctx, &state);
+        unsigned char *grown = realloc(changed, (size_t)ctx->dependency_count);
+        if (!grown) break;
+        changed = grown;
+
+        int count = wait_for_changes(ctx, &state, changed);
+        if (count < 0) break;
+        if (count == 0) continue;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < ctx->dependency_count; i++) {
+            if (changed[i]) invalidate_source(ctx, ctx->dependencies[i]);
+        }
+
+        // La posición de los archivos cambiados es la de la reconstrucción anterior:
+        // se consulta antes de que el recorrido previo la vuelva a anotar
+        int resume = find_resume_chapter(ctx, &state, changed);
+        read_outline(ctx, input_path);
+        if (depfile_path) write_depfile(ctx, depfile_path, output_path);
+
+        if (resume >= 0 && same_structure(ctx, &state) &&
+            incremental_build(ctx, &state, input_path, output_path, resume)) {
+            fprintf(stderr, "'%s' actualizado desde '%s' en %.1f ms\n", output_path,
+                    ctx->chapters[resume].title, elapsed_ms(&start));
+        } else if (full_build(ctx, &state, input_path, output_path)) {
+            fprintf(stderr, "'%s' regenerado en %.1f ms\n", output_path, elapsed_ms(&start));
+        }
+    }
+
+    fprintf(stderr, "Error: Se interrumpió la vigilancia de archivos\n");
+    free(changed);
+    free(state.watches);
+    for (int i = 0; i < state.watched_count; i++) {
+        free(state.watched_dirs[i]);
+    }
+    free(state.watched_dirs);
+    free(state.watched_wds);
+    free(state.chapters);
+    close(state.inotify_fd);
+    return 1;
+}
+
+#else
+
+int watch_document(stroff_context_t *ctx, const char *input_path, const char *output_path,
+                   const char *depfile_path) {
+    (void)ctx;
+    (void)input_path;
+    (void)output_path;
+    (void)depfile_path;
+    fprintf(stderr, "Error: --watch solo está disponible en Linux\n");
+    return 1;
+}
+
+#endif
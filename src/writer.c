@@ -0,0 +1,233 @@
+// clock_gettime, CLOCK_MONOTONIC y writev no forman parte de C99
+#define _POSIX_C_SOURCE 200809L
+
+#include "stroff.h"
+
+// --async-write: la maquetación copia cada página en un anillo de buffers de
+// tamaño fijo y un hilo escritor los vuelca con write/writev sobre el descriptor
+// de la salida. Si el anillo se llena, la maquetación espera (contrapresión); así
+// la E/S lenta se solapa con la maquetación sin acumular el documento en memoria.
+// El anillo tiene un solo productor y un solo consumidor: el cerrojo solo protege
+// los índices, nunca se mantiene durante una copia o una escritura
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <pthread.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#define WRITER_BUFFERS 4
+#define WRITER_BUFFER_SIZE (256 * 1024)
+
+struct output_writer {
+    int fd;
+    char *buffers[WRITER_BUFFERS];
+    size_t lengths[WRITER_BUFFERS];
+    size_t fill;            // Bytes ya copiados en buffers[head] (solo la maquetación)
+    int head;               // Buffer que llena la maquetación
+    int tail;               // Primer buffer pendiente de escribir
+    int pending;            // Buffers llenos entregados al hilo
+    int closing;
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;   // Hay buffers pendientes o se cierra
+    pthread_cond_t space;   // Se liberó algún buffer
+    pthread_t thread;
+    double write_ms;        // Tiempo del hilo dentro de write/writev
+    double stall_ms;        // Tiempo de la maquetación esperando al hilo
+};
+
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1e6;
+}
+
+// Escribe los buffers completos, reintentando tras escrituras parciales
+static int write_all(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+    return 1;
+}
+
+static void *writer_main(void *arg) {
+    output_writer_t *writer = arg;
+    struct iovec iov[WRITER_BUFFERS];
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (writer->pending == 0 && !writer->closing) {
+            pthread_cond_wait(&writer->ready, &writer->lock);
+        }
+        if (writer->pending == 0) break;
+
+        // Todos los buffers pendientes salen en una sola llamada
+        int count = writer->pending;
+        for (int i = 0; i < count; i++) {
+            int index = (writer->tail + i) % WRITER_BUFFERS;
+            iov[i].iov_base = writer->buffers[index];
+            iov[i].iov_len = writer->lengths[index];
+        }
+        pthread_mutex_unlock(&writer->lock);
+
+        double start = now_ms();
+        int ok = writer->failed || write_all(writer->fd, iov, count);
+        double elapsed = now_ms() - start;
+
+        pthread_mutex_lock(&writer->lock);
+        writer->write_ms += elapsed;
+        if (!ok) writer->failed = 1;
+        writer->tail = (writer->tail + count) % WRITER_BUFFERS;
+        writer->pending -= count;
+        pthread_cond_signal(&writer->space);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+output_writer_t *start_output_writer(FILE *output) {
+    output_writer_t *writer = calloc(1, sizeof(output_writer_t));
+    if (!writer) return NULL;
+
+    for (int i = 0; i < WRITER_BUFFERS; i++) {
+        writer->buffers[i] = malloc(WRITER_BUFFER_SIZE);
+        if (!writer->buffers[i]) {
+            for (int j = 0; j < i; j++) free(writer->buffers[j]);
+            free(writer);
+            return NULL;
+        }
+    }
+
+    // El hilo escribe directamente en el descriptor: stdio no debe tener nada pendiente
+    fflush(output);
+    writer->fd = fileno(output);
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->ready, NULL);
+    pthread_cond_init(&writer->space, NULL);
+    if (pthread_create(&writer->thread, NULL, writer_main, writer) != 0) {
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->ready);
+        pthread_cond_destroy(&writer->space);
+        for (int i = 0; i < WRITER_BUFFERS; i++) free(writer->buffers[i]);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+// Entrega buffers[head] al hilo y espera a que quede uno libre para seguir
+static void publish_buffer(output_writer_t *writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->lengths[writer->head] = writer->fill;
+    writer->head = (writer->head + 1) % WRITER_BUFFERS;
+    writer->pending++;
+    pthread_cond_signal(&writer->ready);
+
+    if (writer->pending == WRITER_BUFFERS) {
+        double start = now_ms();
+        while (writer->pending == WRITER_BUFFERS) {
+            pthread_cond_wait(&writer->space, &writer->lock);
+        }
+        writer->stall_ms += now_ms() - start;
+    }
+    pthread_mutex_unlock(&writer->lock);
+    writer->fill = 0;
+}
+
+void writer_append(output_writer_t *writer, const char *data, size_t length) {
+    while (length > 0) {
+        size_t room = WRITER_BUFFER_SIZE - writer->fill;
+        size_t chunk = length < room ? length : room;
+        memcpy(writer->buffers[writer->head] + writer->fill, data, chunk);
+        writer->fill += chunk;
+        data += chunk;
+        length -= chunk;
+
+        if (writer->fill == WRITER_BUFFER_SIZE) {
+            publish_buffer(writer);
+        }
+    }
+}
+
+// Entrega el buffer a medias, espera a que el hilo lo escriba todo y lo termina.
+// Devuelve 0 si alguna escritura falló
+int finish_output_writer(output_writer_t *writer, FILE *output, io_stats_t *stats) {
+    if (writer->fill > 0) {
+        publish_buffer(writer);
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    double start = now_ms();
+    while (writer->pending > 0) {
+        pthread_cond_wait(&writer->space, &writer->lock);
+    }
+    writer->stall_ms += now_ms() - start;
+    writer->closing = 1;
+    pthread_cond_signal(&writer->ready);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    // stdio vuelve a tomar el descriptor (los campos de TOC/TOT se rellenan con fseek)
+    fseek(output, 0, SEEK_END);
+
+    int ok = !writer->failed;
+    if (stats) {
+        stats->write_ms += writer->write_ms;
+        stats->stall_ms += writer->stall_ms;
+    }
+
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->ready);
+    pthread_cond_destroy(&writer->space);
+    for (int i = 0; i < WRITER_BUFFERS; i++) free(writer->buffers[i]);
+    free(writer);
+    return ok;
+}
+
+#else
+
+output_writer_t *start_output_writer(FILE *output) {
+    (void)output;
+    return NULL;
+}
+
+void writer_append(output_writer_t *writer, const char *data, size_t length) {
+    (void)writer;
+    (void)data;
+    (void)length;
+}
+
+int finish_output_writer(output_writer_t *writer, FILE *output, io_stats_t *stats) {
+    (void)writer;
+    (void)output;
+    (void)stats;
+    return 1;
+}
+
+#endif
+
+// Tiempo de E/S oculto tras la maquetación: lo que el hilo escribió mientras la
+// maquetación no lo esperaba
+void print_io_stats(const io_stats_t *stats) {
+    double hidden = stats->write_ms - stats->stall_ms;
+    if (hidden < 0) hidden = 0;
+    double overlap = stats->write_ms > 0 ? 100.0 * hidden / stats->write_ms : 0;
+    fprintf(stderr, "E/S: %.1f ms en write(), %.1f ms de espera de la maquetación, %.0f%% solapado\n",
+            stats->write_ms, stats->stall_ms, overlap);
+}
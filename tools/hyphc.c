@@ -0,0 +1,296 @@
+// hyphc: compila patrones de división silábica (formato TeX) en tablas C.
+// Uso: hyphc patterns/hyph-es.pat patterns/hyph-en.pat > hyph_tables.c
+//
+// Cada archivo hyph-XX.pat da el idioma XX. Los patrones forman un trie cuyas
+// aristas, ordenadas por byte, se guardan en arrays contiguos; los nodos en los
+// que termina un patrón apuntan a sus dígitos. La búsqueda en tiempo de ejecución
+// no reserva memoria
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_PATTERN_LENGTH 64
+#define MAX_NODES 65535
+
+typedef struct {
+    unsigned char c;
+    int target;
+} edge_t;
+
+typedef struct {
+    edge_t *edges;
+    int edge_count;
+    int edge_capacity;
+    unsigned char *digits;  // Posiciones 0..depth del patrón que termina aquí
+    int depth;
+} node_t;
+
+typedef struct {
+    node_t *nodes;
+    int node_count;
+    int node_capacity;
+    int left_min;
+    int right_min;
+} trie_t;
+
+static void *xrealloc(void *data, size_t size) {
+    void *grown = realloc(data, size);
+    if (!grown) {
+        fprintf(stderr, "hyphc: memoria insuficiente\n");
+        exit(1);
+    }
+    return grown;
+}
+
+static int new_node(trie_t *trie, int depth) {
+    if (trie->node_count >= MAX_NODES) {
+        fprintf(stderr, "hyphc: demasiados nodos (máximo %d)\n", MAX_NODES);
+        exit(1);
+    }
+    if (trie->node_count == trie->node_capacity) {
+        trie->node_capacity = trie->node_capacity ? trie->node_capacity * 2 : 256;
+        trie->nodes = xrealloc(trie->nodes, sizeof(node_t) * trie->node_capacity);
+    }
+    node_t *node = &trie->nodes[trie->node_count];
+    memset(node, 0, sizeof(*node));
+    node->depth = depth;
+    return trie->node_count++;
+}
+
+static int child(trie_t *trie, int parent, unsigned char c) {
+    node_t *node = &trie->nodes[parent];
+    for (int i = 0; i < node->edge_count; i++) {
+        if (node->edges[i].c == c) return node->edges[i].target;
+    }
+
+    int target = new_node(trie, trie->nodes[parent].depth + 1);
+    node = &trie->nodes[parent];
+    if (node->edge_count == node->edge_capacity) {
+        node->edge_capacity = node->edge_capacity ? node->edge_capacity * 2 : 4;
+        node->edges = xrealloc(node->edges, sizeof(edge_t) * node->edge_capacity);
+    }
+
+    // Aristas ordenadas por byte para la búsqueda binaria
+    int pos = node->edge_count++;
+    while (pos > 0 && node->edges[pos - 1].c > c) {
+        node->edges[pos] = node->edges[pos - 1];
+        pos--;
+    }
+    node->edges[pos].c = c;
+    node->edges[pos].target = target;
+    return target;
+}
+
+// "1ca" -> letras "ca", dígitos {1,0,0}. Los dígitos van entre caracteres, así que
+// dentro de una secuencia UTF-8 quedan siempre a cero
+static void add_pattern(trie_t *trie, const char *pattern, const char *path) {
+    unsigned char letters[MAX_PATTERN_LENGTH];
+    unsigned char digits[MAX_PATTERN_LENGTH + 1];
+    int length = 0;
+
+    memset(digits, 0, sizeof(digits));
+    for (const char *p = pattern; *p; p++) {
+        if (isdigit((unsigned char)*p)) {
+            digits[length] = (unsigned char)(*p - '0');
+        } else {
+            if (length == MAX_PATTERN_LENGTH) {
+                fprintf(stderr, "hyphc: %s: patrón demasiado largo '%s'\n", path, pattern);
+                exit(1);
+            }
+            letters[length++] = (unsigned char)*p;
+        }
+    }
+    if (length == 0) return;
+
+    int node = 0;
+    for (int i = 0; i < length; i++) {
+        node = child(trie, node, letters[i]);
+    }
+
+    node_t *end = &trie->nodes[node];
+    if (!end->digits) {
+        end->digits = xrealloc(NULL, (size_t)length + 1);
+        memset(end->digits, 0, (size_t)length + 1);
+    }
+    for (int i = 0; i <= length; i++) {
+        if (digits[i] > end->digits[i]) end->digits[i] = digits[i];
+    }
+}
+
+static void load_patterns(trie_t *trie, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "hyphc: no se puede abrir '%s'\n", path);
+        exit(1);
+    }
+
+    char line[1024];
+    int in_exceptions = 0;
+    while (fgets(line, sizeof(line), file)) {
+        char *comment = strchr(line, '%');
+        if (comment) *comment = '\0';
+
+        for (char *token = strtok(line, " \t\r\n"); token; token = strtok(NULL, " \t\r\n")) {
+            // \hyphenation{...}: excepciones, no patrones
+            if (in_exceptions) {
+                if (strchr(token, '}')) in_exceptions = 0;
+                continue;
+            }
+            if (strncmp(token, "\\lefthyphenmin=", 15) == 0) {
+                trie->left_min = atoi(token + 15);
+                continue;
+            }
+            if (strncmp(token, "\\righthyphenmin=", 16) == 0) {
+                trie->right_min = atoi(token + 16);
+                continue;
+            }
+            if (strncmp(token, "\\hyphenation{", 13) == 0) {
+                in_exceptions = strchr(token, '}') == NULL;
+                continue;
+            }
+            if (strncmp(token, "\\patterns{", 10) == 0) {
+                token += 10;
+            } else if (token[0] == '\\') {
+                continue;
+            }
+
+            char *brace = strchr(token, '}');
+            if (brace) *brace = '\0';
+            add_pattern(trie, token, path);
+        }
+    }
+    fclose(file);
+}
+
+// hyph-es.pat -> "es"
+static void language_name(const char *path, char *name, size_t size) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    if (strncmp(base, "hyph-", 5) == 0) base += 5;
+
+    size_t len = strcspn(base, ".");
+    if (len >= size) len = size - 1;
+    memcpy(name, base, len);
+    name[len] = '\0';
+    for (char *p = name; *p; p++) {
+        if (!isalnum((unsigned char)*p)) *p = '_';
+    }
+}
+
+static void emit_array_start(const char *type, const char *lang, const char *field) {
+    printf("static const %s %s_%s[] = {", type, lang, field);
+}
+
+static void emit_value(int value, int index) {
+    printf("%s%d,", index % 16 == 0 ? "\n    " : " ", value);
+}
+
+static void emit_trie(const trie_t *trie, const char *lang) {
+    int edge_total = 0;
+    int value_total = 1;
+
+    emit_array_start("unsigned short", lang, "first_edge");
+    for (int n = 0; n <= trie->node_count; n++) {
+        emit_value(edge_total, n);
+        if (n < trie->node_count) edge_total += trie->nodes[n].edge_count;
+    }
+    printf("\n};\n\n");
+    if (edge_total > MAX_NODES) {
+        fprintf(stderr, "hyphc: demasiadas aristas en '%s'\n", lang);
+        exit(1);
+    }
+
+    emit_array_start("unsigned char", lang, "edge_chars");
+    int index = 0;
+    for (int n = 0; n < trie->node_count; n++) {
+        for (int e = 0; e < trie->nodes[n].edge_count; e++) {
+            emit_value(trie->nodes[n].edges[e].c, index++);
+        }
+    }
+    if (index == 0) emit_value(0, 0);
+    printf("\n};\n\n");
+
+    emit_array_start("unsigned short", lang, "edge_targets");
+    index = 0;
+    for (int n = 0; n < trie->node_count; n++) {
+        for (int e = 0; e < trie->nodes[n].edge_count; e++) {
+            emit_value(trie->nodes[n].edges[e].target, index++);
+        }
+    }
+    if (index == 0) emit_value(0, 0);
+    printf("\n};\n\n");
+
+    // Offset 0 de values: nodo sin patrón
+    emit_array_start("unsigned short", lang, "node_values");
+    for (int n = 0; n < trie->node_count; n++) {
+        const node_t *node = &trie->nodes[n];
+        emit_value(node->digits ? value_total : 0, n);
+        if (node->digits) value_total += node->depth + 2;
+    }
+    printf("\n};\n\n");
+    if (value_total > MAX_NODES) {
+        fprintf(stderr, "hyphc: demasiados valores en '%s'\n", lang);
+        exit(1);
+    }
+
+    // Cada entrada: número de posiciones y un dígito por posición
+    emit_array_start("unsigned char", lang, "values");
+    index = 0;
+    emit_value(0, index++);
+    for (int n = 0; n < trie->node_count; n++) {
+        const node_t *node = &trie->nodes[n];
+        if (!node->digits) continue;
+        emit_value(node->depth + 1, index++);
+        for (int i = 0; i <= node->depth; i++) {
+            emit_value(node->digits[i], index++);
+        }
+    }
+    printf("\n};\n\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: %s hyph-XX.pat... > hyph_tables.c\n", argv[0]);
+        return 1;
+    }
+
+    printf("// Generado por tools/hyphc a partir de los patrones de patterns/: no editar\n\n");
+    printf("#include \"stroff.h\"\n\n");
+
+    char (*names)[32] = xrealloc(NULL, sizeof(*names) * (size_t)(argc - 1));
+    int left_min[argc];
+    int right_min[argc];
+
+    for (int i = 1; i < argc; i++) {
+        trie_t trie;
+        memset(&trie, 0, sizeof(trie));
+        trie.left_min = 2;
+        trie.right_min = 2;
+        new_node(&trie, 0);
+
+        load_patterns(&trie, argv[i]);
+        language_name(argv[i], names[i - 1], sizeof(names[i - 1]));
+        emit_trie(&trie, names[i - 1]);
+        left_min[i - 1] = trie.left_min;
+        right_min[i - 1] = trie.right_min;
+
+        for (int n = 0; n < trie.node_count; n++) {
+            free(trie.nodes[n].edges);
+            free(trie.nodes[n].digits);
+        }
+        free(trie.nodes);
+    }
+
+    printf("const hyph_trie_t hyph_tries[] = {\n");
+    for (int i = 0; i < argc - 1; i++) {
+        const char *lang = names[i];
+        printf("    {\"%s\", %d, %d, %s_first_edge, %s_edge_chars, %s_edge_targets, %s_node_values, %s_values},\n",
+               lang, left_min[i], right_min[i], lang, lang, lang, lang, lang);
+    }
+    printf("};\n\nconst int hyph_trie_count = %d;\n", argc - 1);
+
+    free(names);
+    return 0;
+}